@@ -6,12 +6,13 @@
 #   Install the 'pty' program or provide it's path to $PATH.
 
 # Description:
-#   The 'script' program. Run in a new shell and copy everything what appears on
-#   console screen to file named 'typescript' or to filename.
-#   Verbose mode is activated.
+#   The 'script' program. Run in a new shell and record everything what appears
+#   on console screen and what is typed, with timing, to file named 'typescript'
+#   or to filename (first argument). The recording is appended to the file, it
+#   is binary (see REC_MAGIC in pty.h).
 #   Abort with CTRL-C or SIGTERM.
 
-pty "${SHELL:-/bin/sh}" | tee typescript
+pty -w "${1:-typescript}" "${SHELL:-/bin/sh}"
 
 exit $?
 
@@ -0,0 +1,444 @@
+/* vi: set sw=4 ts=4: */
+
+/*
+ * Copyright (C) 2020
+ * Khoa Sebastian Nguyen
+ * <sebastian.nguyen@asog-central.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \brief    Microbenchmarks of the HEX codec and the hcat() paths. Results are
+ *           printed as JSON, one result object per line, so a stored run can
+ *           be given as baseline (-b) to the next one.
+ * \note     Built as one unit with pty.c to reach its static parts: _bflush()
+ *           and every HEX kernel, not only the one selected for this CPU.
+ */
+
+#include "pty.c"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+  #include <x86intrin.h>      // __rdtsc()
+  #define BENCH_HAVE_TSC
+#endif
+
+#define BENCH_MIN_SIZE  ( 16 )
+#define BENCH_MAX_SIZE  ( 1024UL*1024*1024 )
+#define BENCH_STEP      ( 4 )       // size factor between two runs
+#define BENCH_MIN_TIME  ( 0.2 )     // seconds per measurement
+#define BENCH_LINE      ( 512 )
+#define BENCH_NAME      ( 32 )
+
+
+#ifdef LINUX
+  #define OPTSTR "+b:m:t:hv"
+#else
+  #define OPTSTR "b:m:t:hv"
+#endif
+
+
+/*!
+ * \brief    Allocation counter. malloc() and friends of glibc are wrapped, so
+ *           allocations of the measured functions are counted as well.
+ */
+static unsigned long allocs = 0;
+
+extern "C" {
+  void *__libc_malloc( size_t size );
+  void *__libc_calloc( size_t nmemb, size_t size );
+  void *__libc_realloc( void *ptr, size_t size );
+
+  void *malloc( size_t size ) __THROW
+  {
+    __atomic_fetch_add( &allocs, 1, __ATOMIC_RELAXED );
+    return ( __libc_malloc( size ) );
+  }
+
+  void *calloc( size_t nmemb, size_t size ) __THROW
+  {
+    __atomic_fetch_add( &allocs, 1, __ATOMIC_RELAXED );
+    return ( __libc_calloc( nmemb, size ) );
+  }
+
+  void *realloc( void *ptr, size_t size ) __THROW
+  {
+    __atomic_fetch_add( &allocs, 1, __ATOMIC_RELAXED );
+    return ( __libc_realloc( ptr, size ) );
+  }
+}
+
+
+typedef struct {
+  char name[BENCH_NAME];
+  char kernel[BENCH_NAME];
+  size_t size;                // bytes of input per round
+  unsigned long rounds;
+  double seconds;
+  double cycles;              // TSC ticks, 0 if not available
+  unsigned long allocs;
+} tBench_result;
+
+
+typedef struct {
+  char name[BENCH_NAME];
+  char kernel[BENCH_NAME];
+  size_t size;
+  double bytes_per_s;
+} tBench_baseline;
+
+
+typedef struct {
+  uint8_t *raw;               // size bytes
+  char *txt;                  // 2*size characters of HEX
+  size_t size;
+} tBench_codec;
+
+
+typedef struct {
+  int fd_out;
+  char *argv[2];              // input file, NULL
+  int a2h;
+  int h2a;
+  const tHexdump_fmt *dump;
+} tBench_hcat;
+
+
+static tBench_baseline *baseline = NULL;
+static size_t nbaseline = 0;
+static double min_time = BENCH_MIN_TIME;
+static int verbose = 0;
+static int first = 1;         // no comma before the first result
+
+
+static double _now( void )
+{
+  struct timespec t;
+
+  clock_gettime( CLOCK_MONOTONIC, &t );
+
+  return ( (double)t.tv_sec + 1e-9*(double)t.tv_nsec );
+}
+
+
+static double _ticks( void )
+{
+#if defined( BENCH_HAVE_TSC )
+  return ( (double)__rdtsc() );
+#else
+  return ( 0.0 );
+#endif
+}
+
+
+static void _measure( tBench_result *res, void (*run)( void* ), void *ctx )
+{
+  unsigned long a0;
+  double t0, c0;
+
+  run( ctx ); // warm up caches and page tables
+
+  res->rounds = 0;
+  a0 = __atomic_load_n( &allocs, __ATOMIC_RELAXED );
+  c0 = _ticks();
+  t0 = _now();
+
+  do {
+    run( ctx );
+    res->rounds++;
+  } while ( (res->seconds = _now() - t0) < min_time );
+
+  res->cycles = _ticks() - c0;
+  res->allocs = __atomic_load_n( &allocs, __ATOMIC_RELAXED ) - a0;
+}
+
+
+static void _print( const tBench_result *res )
+{
+  double bytes = (double)res->size * (double)res->rounds;
+  double bps = bytes / res->seconds;
+  size_t i;
+
+  printf( "%s    {\"name\": \"%s\", \"kernel\": \"%s\", \"size\": %lu, "
+          "\"rounds\": %lu, \"seconds\": %.6f, \"bytes_per_s\": %.0f, "
+          "\"cycles_per_byte\": %.4f, \"allocs_per_round\": %.2f",
+          (1 == first) ? "" : ",\n", res->name, res->kernel,
+          (unsigned long)res->size, res->rounds, res->seconds, bps,
+          res->cycles / bytes, (double)res->allocs / (double)res->rounds );
+
+  for ( i=0; i<nbaseline; i++ ) {
+    if ( (0 == strcmp( baseline[i].name, res->name )) &&
+         (0 == strcmp( baseline[i].kernel, res->kernel )) &&
+         (baseline[i].size == res->size) && (baseline[i].bytes_per_s > 0) ) {
+      printf( ", \"baseline_ratio\": %.3f", bps / baseline[i].bytes_per_s );
+      break;
+    }
+  }
+
+  printf( "}" );
+  fflush( stdout );
+  first = 0;
+
+  if ( 1 == verbose )
+    fprintf( stderr, "%-12s %-8s %12lu bytes: %14.0f bytes/s\n", res->name,
+             res->kernel, (unsigned long)res->size, bps );
+}
+
+
+/*!
+ * \brief    Read the result lines of an earlier run.
+ */
+static void _load_baseline( const char *filename )
+{
+  char line[BENCH_LINE];
+  tBench_baseline b;
+  unsigned long size;
+  const char *p;
+  FILE *f;
+  void *q;
+
+  if ( NULL == (f = fopen( filename, "r" )) )
+    err_sys( "Cannot open baseline %s", filename );
+
+  while ( NULL != fgets( line, sizeof( line ), f ) ) {
+    if ( 3 != sscanf( line, " {\"name\": \"%31[^\"]\", \"kernel\": \"%31[^\"]\", "
+                      "\"size\": %lu", b.name, b.kernel, &size ) )
+      continue;
+
+    if ( (NULL == (p = strstr( line, "\"bytes_per_s\": " ))) ||
+         (1 != sscanf( p, "\"bytes_per_s\": %lf", &b.bytes_per_s )) )
+      continue;
+
+    b.size = (size_t)size;
+
+    if ( NULL == (q = realloc( baseline, (nbaseline+1)*sizeof( b ) )) )
+      err_sys( "Not enough space for baseline" );
+    baseline = (tBench_baseline*)q;
+    baseline[nbaseline++] = b;
+  }
+
+  fclose( f );
+}
+
+
+static void _run_decode( void *ctx )
+{
+  tBench_codec *c = (tBench_codec*)ctx;
+
+  snprintu8( c->raw, c->size/2, c->txt, c->size );
+}
+
+
+static void _run_encode( void *ctx )
+{
+  tBench_codec *c = (tBench_codec*)ctx;
+
+  u8nprints( c->txt, 2*c->size, c->raw, c->size );
+}
+
+
+static void _run_bflush( void *ctx )
+{
+  tBench_codec *c = (tBench_codec*)ctx;
+
+  _bflush( c->txt, c->size, &ascii_null );
+}
+
+
+static void _run_hcat( void *ctx )
+{
+  tBench_hcat *h = (tBench_hcat*)ctx;
+
+  if ( (0 > ftruncate( h->fd_out, 0 )) || (0 > lseek( h->fd_out, 0, SEEK_SET )) )
+    err_sys( "Cannot reset benchmark output file" );
+
+  if ( EXIT_SUCCESS != hcat( h->fd_out, h->argv, h->a2h, h->h2a, h->dump, 0 ) )
+    err_quit( "hcat() failed on %s", h->argv[0] );
+}
+
+
+static void _bench_codec( size_t size )
+{
+  const tHex_kernel *selected = hex_kernel;
+  tBench_codec c;
+  tBench_result res;
+  size_t i, k;
+
+  c.size = size;
+  if ( (NULL == (c.raw = (uint8_t*)malloc( size ))) ||
+       (NULL == (c.txt = (char*)malloc( 2*size ))) )
+    err_sys( "Not enough space for %lu bytes of benchmark data",
+             (unsigned long)size );
+
+  for ( i=0; i<size; i++ )
+    c.raw[i] = (uint8_t)rand();
+  u8nprints( c.txt, 2*size, c.raw, size );
+
+  res.size = size;
+
+  for ( k=0; k<HEX_KERNELS; k++ ) {
+    if ( ! hex_kernels[k].supported() )
+      continue;
+
+    hex_kernel = &hex_kernels[k];
+    snprintf( res.kernel, BENCH_NAME, "%s", hex_kernel->name );
+
+    // Input of snprintu8() are size characters:
+    snprintf( res.name, BENCH_NAME, "snprintu8" );
+    _measure( &res, _run_decode, &c );
+    _print( &res );
+
+    snprintf( res.name, BENCH_NAME, "u8nprints" );
+    _measure( &res, _run_encode, &c );
+    _print( &res );
+  }
+
+  hex_kernel = selected;
+
+  snprintf( res.name, BENCH_NAME, "_bflush" );
+  snprintf( res.kernel, BENCH_NAME, "-" );
+  _measure( &res, _run_bflush, &c );
+  _print( &res );
+
+  free( c.raw );
+  free( c.txt );
+}
+
+
+static void _bench_hcat( size_t size, const char *tmpdir )
+{
+  char in_name[BENCH_LINE], out_name[BENCH_LINE];
+  char chunk[64*1024];
+  tHexdump_fmt fmt;
+  tBench_hcat h;
+  tBench_result res;
+  size_t i, n;
+  int fd_in;
+
+  // Input is HEX text, valid for every mode:
+  snprintf( in_name, sizeof( in_name ), "%s/pty-bench-in.XXXXXX", tmpdir );
+  snprintf( out_name, sizeof( out_name ), "%s/pty-bench-out.XXXXXX", tmpdir );
+  if ( (0 > (fd_in = mkstemp( in_name ))) ||
+       (0 > (h.fd_out = mkstemp( out_name ))) )
+    err_sys( "Cannot create benchmark files in %s", tmpdir );
+
+  for ( i=0; i<sizeof( chunk ); i++ )
+    chunk[i] = "0123456789abcdef"[rand() & 0x0F];
+
+  for ( i=0; i<size; i+=n ) {
+    n = (size - i < sizeof( chunk )) ? size - i : sizeof( chunk );
+    if ( (ssize_t)n != full_write( fd_in, chunk, n ) )
+      err_sys( "Cannot write benchmark input %s", in_name );
+  }
+  close( fd_in );
+
+  fmt.cols = 16;
+  fmt.group = 2;
+  fmt.swap = 0;
+  fmt.offset = 1;
+  fmt.ascii = 1;
+
+  h.argv[0] = in_name;
+  h.argv[1] = NULL;
+  res.size = size;
+  snprintf( res.kernel, BENCH_NAME, "%s", hex_kernel_name() );
+
+  h.a2h = 0; h.h2a = 0; h.dump = NULL;
+  snprintf( res.name, BENCH_NAME, "hcat" );
+  _measure( &res, _run_hcat, &h );
+  _print( &res );
+
+  h.a2h = 1; h.h2a = 0; h.dump = NULL;
+  snprintf( res.name, BENCH_NAME, "hcat -A" );
+  _measure( &res, _run_hcat, &h );
+  _print( &res );
+
+  h.a2h = 0; h.h2a = 1; h.dump = NULL;
+  snprintf( res.name, BENCH_NAME, "hcat -H" );
+  _measure( &res, _run_hcat, &h );
+  _print( &res );
+
+  h.a2h = 0; h.h2a = 0; h.dump = &fmt;
+  snprintf( res.name, BENCH_NAME, "hcat -D" );
+  _measure( &res, _run_hcat, &h );
+  _print( &res );
+
+  close( h.fd_out );
+  unlink( in_name );
+  unlink( out_name );
+}
+
+
+static void usage( const char *program_name )
+{
+  printf( "Usage: %s [OPTIONS]\n", program_name );
+  printf( " OPTIONS:\n" );
+  printf( " -b <file> : Baseline of an earlier run to compare with.\n" );
+  printf( " -m <size> : Largest input size in bytes (default %lu).\n",
+          (unsigned long)BENCH_MAX_SIZE );
+  printf( " -t <sec>  : Minimum time per measurement (default %.1f).\n",
+          BENCH_MIN_TIME );
+  printf( " -h : Print this help.\n" );
+  printf( " -v : Print progress on stderr.\n" );
+  printf( "\n" );
+  printf( " Input sizes run from %i bytes up, factor %i each.\n",
+          BENCH_MIN_SIZE, BENCH_STEP );
+}
+
+
+int main( int argc, char **argv )
+{
+  size_t size, max_size = BENCH_MAX_SIZE;
+  const char *tmpdir;
+  int c;
+
+  opterr = 0;
+  while ( EOF != (c = getopt( argc, argv, OPTSTR )) )
+  {
+    switch( c ) {
+      case 'b' : _load_baseline( optarg );                      break;
+      case 'm' : max_size = (size_t)strtoull( optarg, NULL, 0 );  break;
+      case 't' : min_time = atof( optarg );                     break;
+      case 'v' : verbose = 1;                                   break;
+      case 'h' : usage( argv[0] );
+                 exit( 0 );
+      case '?' : err_quit( "Unrecognized option: -%c", optopt ); break;
+    }
+  }
+
+  if ( NULL == (tmpdir = getenv( "TMPDIR" )) )
+    tmpdir = "/tmp";
+
+  printf( "{\n  \"hex_kernel\": \"%s\",\n  \"min_time\": %.3f,\n"
+          "  \"tsc\": %s,\n  \"results\": [\n", hex_kernel_name(), min_time,
+#if defined( BENCH_HAVE_TSC )
+          "true"
+#else
+          "false"
+#endif
+        );
+
+  for ( size=BENCH_MIN_SIZE; size<=max_size; size*=BENCH_STEP ) {
+    _bench_codec( size );
+    _bench_hcat( size, tmpdir );
+  }
+
+  printf( "\n  ]\n}\n" );
+
+  free( baseline );
+
+  return ( 0 );
+}
+// EOF
@@ -2,6 +2,8 @@
  * of the target device.
  */
 
+#define _GNU_SOURCE	/* ppoll() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +15,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "pace.h"
 
 #define DEBUG 0
 
@@ -22,37 +32,82 @@
 #define MAX_RESP_DELAY	1
 #endif
 
-#define BUFLEN		512
+#define BUFLEN		16384
 #define MAX_CONFIG_LEN	1024
 #define CONFIG_FILE	"/.captureconfig"
 #define CC_TAG		"cc="
 #define CHAR_DELAY_TAG	"delay="
+#define PACE_TAG	"pace="
 #define TIMEOUT_TAG	"show_timeout="
 #define TIME_USED_TAG	"show_timeout_usage="
-#define TIMEOUT_GRANULARITY 100
+#define NS_PER_MS	1000000LL
 #define MIN_MARGIN	30
 #define MARGIN_WARN	"TIMEOUT CRITICAL"
 
 #define ARG_TIMEOUT	"-t"
 #define ARG_DEVICE	"-d"
 #define ARG_EXITTEXT	"-e"
+#define ARG_MATCH	"-m"
+#define ARG_REGEX	"-r"
+#define ARG_REGEXCODE	"-R"
+#define ARG_SCRIPT	"-f"
+#define ARG_PIPELINE	"-p"
+#define ARG_SERVER	"-S"
 #define ARG_VERBOSE	"-v"
 #define ARG_USAGE1	"-h"
 #define ARG_USAGE2	"--help"
 #define TIMEOUT_DEFAULT	1000
 #define DEVICE_DEFAULT	"/dev/ttyS0"
+#define SOCKET_FMT	"/tmp/capture-%u%s"	/* uid, device with '/' as '_' */
+#define MAX_REQUEST	65536
 
 #define RETURN_MATCH	0
 #define RETURN_TIMEOUT	1
 #define RETURN_ERROR	2
 
+#define MAX_PATTERNS	32
+#define ALPHABET	256
+
 struct termios orig_termios;
 int dut_con;
+const char *dut_name;
 int ccfile;
 int cc = 0;
+unsigned int chardelay = 0;
+tPace pace;		/* pacing of the writes to the device */
+unsigned int show_timeout = 0;
+unsigned int show_timeout_usage = 0;
+
+/* input behind an exit text, kept for the next step in script mode */
+char pending[BUFLEN];
+ssize_t npending = 0;
+
+/* server mode: socket to remove at exit, set in the server only */
+char sockname[sizeof(((struct sockaddr_un *)0)->sun_path)];
+int served = 0;		/* request of a client, device opened by the server */
+volatile sig_atomic_t stop = 0;
 
 FILE* fconfig;
 
+/* exit text and the exit code when it is seen */
+struct pattern {
+	const char *text;
+	int code;
+	int regex;		/* text is a regular expression */
+};
+
+/*
+ * Aho-Corasick automaton of all exit texts, completed to a DFA: each state
+ * has a transition for every byte, so the scan costs one table lookup per
+ * byte however many exit texts there are. A state completing an exit text
+ * (or ending in one) knows which.
+ */
+struct matcher {
+	unsigned int nstates;
+	unsigned int *next;	/* nstates * ALPHABET transitions */
+	int *match;		/* index of the exit text, -1 for none */
+};
+
 void die(const char *s) {
 	printf("ERROR: %s\n", s);
 	exit(RETURN_ERROR);
@@ -61,19 +116,32 @@ void die(const char *s) {
 
 void usage(char* progname) {
 	printf("%s sends strings to serial port and captures response:\n", progname);
-	printf("Usage: %s [-h] [-v] [-t timeout] [-d device] [-e exit_text] \"command line\"\n", progname);
+	printf("Usage: %s [-h] [-v] [-t timeout] [-d device] [-e exit_text] [-m code:exit_text] \"command line\"\n", progname);
 	printf("Send \"command line\" to \"device\" and wait for \"exit_text\" as reponse, but not longer than \"timeout\" ms.\n");
+	printf("-r regex and -R code:regex wait for a regular expression like -e and -m do for a text.\n");
+	printf("Supported: . [] [^] \\d \\w \\s \\t \\r \\n \\xHH () | * + ? {m,n} and ^ at the start for a line start.\n");
+	printf("-e, -m, -r and -R can be given up to %d times, the first exit text seen ends the wait.\n", MAX_PATTERNS);
+	printf("Script mode: %s [-v] [-t timeout] [-d device] [-p depth] -f script (- for stdin)\n", progname);
+	printf("Each script line is a step: \"command line<TAB>exit_text<TAB>timeout\", exit text and\n");
+	printf("timeout are optional. Lines starting with # are comments. The script stops at the\n");
+	printf("first step timing out, its exit status is returned. A step without exit text just\n");
+	printf("waits for its timeout. -p sends up to \"depth\" commands ahead of the responses.\n");
+	printf("Server mode: %s -S [-v] [-d device] keeps \"device\" open and raw, later calls for\n", progname);
+	printf("it are run by the server, saving the setup of the device. Without server (or with\n");
+	printf("-f -) %s opens the device itself.\n", progname);
+	printf("Exit status is 0 for an -e exit text, \"code\" for a -m one, %d on timeout, %d on error.\n", RETURN_TIMEOUT, RETURN_ERROR);
 	printf("Default for \"device\" is /dev/ttyS0\n");
 	printf("Default for \"timeout\" is 1000(ms)\n");
-	printf("Timeout resolution is limited to chunks of 100ms\n");
+	printf("Timeout counts from sending \"command line\", in milliseconds\n");
 	printf("Be sure to enclose \"command line\" in double quotes if it contains spaces.\n");
 	printf("If you don't want to send anything, use \"\" as \"command line\"\n");
+	printf("Slow devices: \"pace=bytes/s[,burst[,gap ms]]\" in ~%s paces the writes.\n", CONFIG_FILE);
 	exit(RETURN_ERROR);
 }
 
 
 /* put terminal in raw mode - see termio(7I) for modes */
-void tty_raw(int fd, unsigned int timeout)
+void tty_raw(int fd)
 {
 	struct termios raw;
 
@@ -98,7 +166,7 @@ void tty_raw(int fd, unsigned int timeout)
 						after first byte seen      */
 	raw.c_cc[VMIN] = 0; raw.c_cc[VTIME] = 0; /* immediate - anything       */
 	raw.c_cc[VMIN] = 2; raw.c_cc[VTIME] = 0; /* after two bytes, no timer  */
-	raw.c_cc[VMIN] = 0; raw.c_cc[VTIME] = timeout/TIMEOUT_GRANULARITY; /* after a byte or 1 second  */
+	raw.c_cc[VMIN] = 0; raw.c_cc[VTIME] = 0; /* immediate, ppoll() waits  */
 
 	/* put terminal in raw mode after flushing */
 	if (tcsetattr(fd, TCSAFLUSH,&raw) < 0)
@@ -109,61 +177,1077 @@ void tty_raw(int fd, unsigned int timeout)
 /* exit handler for tty reset */
 void tty_atexit(void) {
 
+	/* the server keeps the device raw for the next request */
+	if (served)
+		return;
+
 	//printf("Restored previous tty settings...\n");
 	tcsetattr(dut_con, TCSAFLUSH, &orig_termios);
 }
 
 
-unsigned int rematch(char *pattern, char *buf, unsigned int current) {
-	unsigned int n;
-	unsigned int m;
-
-	for (n=1; n<=current; n++) {
-		//write(STDOUT_FILENO, buf+n-1, 1);
-		if (cc) write(ccfile, buf+n-1, 1);
-		if (strncmp(buf+n, pattern, current-n) == 0) {
-			for (m=0; m<(current-n); m++) {
-				buf[m] = buf[n+m];
+/* monotonic clock in ns, for the deadline */
+long long now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+ * Build the automaton: a trie of the exit texts first, then breadth first
+ * the failure links, which also fill in the missing transitions. An exit
+ * text ending inside a longer one is found through the failure link.
+ */
+void matcher_build(struct matcher *m, struct pattern *p, int np) {
+	unsigned int total = 1;
+	unsigned int *fail, *queue;
+	unsigned int head = 0, tail = 0;
+	unsigned int r, s, c;
+	const unsigned char *t;
+	int i;
+
+	for (i=0; i<np; i++)
+		total += strlen(p[i].text);
+
+	m->next = calloc((size_t)total * ALPHABET, sizeof(unsigned int));
+	m->match = malloc(total * sizeof(int));
+	fail = calloc(total, sizeof(unsigned int));
+	queue = malloc(total * sizeof(unsigned int));
+	if (!m->next || !m->match || !fail || !queue)
+		die("Out of memory!");
+
+	for (s=0; s<total; s++)
+		m->match[s] = -1;
+
+	m->nstates = 1;
+	for (i=0; i<np; i++) {
+		s = 0;
+		for (t=(const unsigned char *)p[i].text; *t; t++) {
+			if (!m->next[s*ALPHABET + *t])
+				m->next[s*ALPHABET + *t] = m->nstates++;
+			s = m->next[s*ALPHABET + *t];
+		}
+		if (m->match[s] < 0)
+			m->match[s] = i;
+	}
+
+	for (c=0; c<ALPHABET; c++) {
+		if ((s = m->next[c]) != 0)
+			queue[tail++] = s;
+	}
+
+	while (head < tail) {
+		r = queue[head++];
+		if (m->match[r] < 0)
+			m->match[r] = m->match[fail[r]];
+
+		for (c=0; c<ALPHABET; c++) {
+			s = m->next[r*ALPHABET + c];
+			if (s) {
+				fail[s] = m->next[fail[r]*ALPHABET + c];
+				queue[tail++] = s;
+			} else {
+				m->next[r*ALPHABET + c] = m->next[fail[r]*ALPHABET + c];
 			}
-			buf[m]=0;
-			return (current-n);
 		}
 	}
 
+	free(fail);
+	free(queue);
+}
+
+
+/*
+ * Feed a chunk of input. Returns the number of bytes consumed, up to and
+ * including the end of an exit text; *found is its index or -1.
+ */
+ssize_t matcher_scan(struct matcher *m, unsigned int *state, const char *buf,
+		ssize_t len, int *found) {
+	const unsigned char *u = (const unsigned char *)buf;
+	unsigned int s = *state;
+	ssize_t i;
+
+	*found = -1;
+	for (i=0; i<len; i++) {
+		s = m->next[s*ALPHABET + u[i]];
+		if (m->match[s] >= 0) {
+			*found = m->match[s];
+			i++;
+			break;
+		}
+	}
+
+	*state = s;
+	return i;
+}
+
+
+void matcher_free(struct matcher *m) {
+	free(m->next);
+	free(m->match);
+}
+
+
+/*
+ * Regular expressions (-r, -R) are compiled into the same kind of DFA as
+ * the exit texts, so the scan stays one table lookup per byte and keeps no
+ * input to look at again. The way there: syntax tree, Thompson NFA, then
+ * the subset construction, all once before the command is sent. The DFA
+ * is limited to MAX_DFA_STATES, memory does not grow with the input.
+ *
+ * The search is unanchored, the earliest end of a match ends the wait.
+ * '.' matches any byte but newline, '^' (at the start only) matches at the
+ * start of a line. There is no '$', use \r or \n.
+ */
+#define MAX_NODES	4096
+#define MAX_NFA		8192
+#define MAX_DFA_STATES	4096
+#define MAX_REPEAT	255
+#define SET_BYTES	(ALPHABET/8)
+#define SET_ADD(set, c)	((set)[(c) >> 3] |= (unsigned char)(1 << ((c) & 7)))
+#define SET_HAS(set, c)	((set)[(c) >> 3] & (1 << ((c) & 7)))
+
+enum { RE_SET, RE_CAT, RE_ALT, RE_STAR, RE_PLUS, RE_QUEST, RE_EMPTY };
+enum { NFA_SET, NFA_SPLIT, NFA_MATCH };
+
+struct re_node {
+	int type;
+	int a, b;			/* operands */
+	unsigned char set[SET_BYTES];	/* RE_SET: bytes matching */
+};
+
+struct nfa_state {
+	int type;
+	int out, out1;
+	const unsigned char *set;	/* NFA_SET */
+	int pattern;			/* NFA_MATCH */
+};
+
+struct re {
+	const char *text;		/* for error messages */
+	const char *p;			/* parse position */
+	struct re_node node[MAX_NODES];
+	int nnodes;
+	struct nfa_state nfa[MAX_NFA];
+	int nnfa;
+};
+
+
+void re_fail(struct re *r, const char *why) {
+	char msg[MAX_CONFIG_LEN];
+
+	snprintf(msg, sizeof(msg), "regular expression \"%s\": %s", r->text, why);
+	die(msg);
+}
+
+
+int re_new(struct re *r, int type, int a, int b) {
+	if (r->nnodes == MAX_NODES)
+		re_fail(r, "too complex");
+
+	memset(&r->node[r->nnodes], 0, sizeof(struct re_node));
+	r->node[r->nnodes].type = type;
+	r->node[r->nnodes].a = a;
+	r->node[r->nnodes].b = b;
+	return r->nnodes++;
+}
+
+
+int hexval(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+
+/* the escape behind a backslash, added to set */
+void re_escape(struct re *r, unsigned char *set) {
+	unsigned char cls[SET_BYTES];
+	int c, neg = 0, i;
+
+	memset(cls, 0, sizeof(cls));
+	switch (c = (unsigned char)*r->p++) {
+	case 0:
+		re_fail(r, "trailing backslash");
+		break;
+	case 'D': neg = 1; /* fall through */
+	case 'd':
+		for (c='0'; c<='9'; c++) SET_ADD(cls, c);
+		break;
+	case 'W': neg = 1; /* fall through */
+	case 'w':
+		for (c=0; c<ALPHABET; c++)
+			if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+				SET_ADD(cls, c);
+		break;
+	case 'S': neg = 1; /* fall through */
+	case 's':
+		SET_ADD(cls, ' '); SET_ADD(cls, '\t'); SET_ADD(cls, '\r');
+		SET_ADD(cls, '\n'); SET_ADD(cls, '\f'); SET_ADD(cls, '\v');
+		break;
+	case 't': SET_ADD(cls, '\t'); break;
+	case 'r': SET_ADD(cls, '\r'); break;
+	case 'n': SET_ADD(cls, '\n'); break;
+	case 'f': SET_ADD(cls, '\f'); break;
+	case 'v': SET_ADD(cls, '\v'); break;
+	case 'x':
+		if (hexval(r->p[0]) < 0 || hexval(r->p[1]) < 0)
+			re_fail(r, "\\x needs two hex digits");
+		c = hexval(r->p[0]) * 16 + hexval(r->p[1]);
+		r->p += 2;
+		SET_ADD(cls, c);
+		break;
+	default:
+		SET_ADD(cls, c);
+	}
+
+	for (i=0; i<SET_BYTES; i++)
+		set[i] |= neg ? (unsigned char)~cls[i] : cls[i];
+}
+
+
+int re_bracket(struct re *r) {
+	unsigned char set[SET_BYTES];
+	int n, i, c, hi, neg = 0;
+
+	memset(set, 0, sizeof(set));
+	if (*r->p == '^') {
+		neg = 1;
+		r->p++;
+	}
+
+	/* a ']' first is a member */
+	do {
+		if (*r->p == 0)
+			re_fail(r, "missing ]");
+		if (*r->p == '\\') {
+			r->p++;
+			re_escape(r, set);
+			continue;
+		}
+		c = (unsigned char)*r->p++;
+		if (r->p[0] == '-' && r->p[1] != ']' && r->p[1] != 0) {
+			hi = (unsigned char)r->p[1];
+			r->p += 2;
+			if (hi < c)
+				re_fail(r, "invalid range");
+			for (; c<=hi; c++)
+				SET_ADD(set, c);
+		} else {
+			SET_ADD(set, c);
+		}
+	} while (*r->p != ']');
+	r->p++;
+
+	n = re_new(r, RE_SET, -1, -1);
+	for (i=0; i<SET_BYTES; i++)
+		r->node[n].set[i] = neg ? (unsigned char)~set[i] : set[i];
 	return n;
 }
 
 
-int main(int argc, char* argv[]) {
+int re_alt(struct re *r);
+
+int re_atom(struct re *r) {
+	int n;
+
+	switch (*r->p) {
+	case '(':
+		r->p++;
+		n = re_alt(r);
+		if (*r->p != ')')
+			re_fail(r, "missing )");
+		r->p++;
+		return n;
+	case '[':
+		r->p++;
+		return re_bracket(r);
+	case '.':
+		r->p++;
+		n = re_new(r, RE_SET, -1, -1);
+		memset(r->node[n].set, 0xFF, SET_BYTES);
+		r->node[n].set['\n' >> 3] &= (unsigned char)~(1 << ('\n' & 7));
+		return n;
+	case '\\':
+		r->p++;
+		n = re_new(r, RE_SET, -1, -1);
+		re_escape(r, r->node[n].set);
+		return n;
+	case '*': case '+': case '?': case '{':
+		re_fail(r, "nothing to repeat");
+		break;
+	case '^':
+		re_fail(r, "^ is supported at the start only");
+		break;
+	case '$':
+		re_fail(r, "$ is not supported, use \\r or \\n");
+		break;
+	}
+
+	n = re_new(r, RE_SET, -1, -1);
+	SET_ADD(r->node[n].set, (unsigned char)*r->p);
+	r->p++;
+	return n;
+}
+
+
+int re_repeat(struct re *r) {
+	int n, rep, min, max, i, len;
+
+	n = re_atom(r);
+	for (;;) {
+		switch (*r->p) {
+		case '*': r->p++; n = re_new(r, RE_STAR, n, -1); continue;
+		case '+': r->p++; n = re_new(r, RE_PLUS, n, -1); continue;
+		case '?': r->p++; n = re_new(r, RE_QUEST, n, -1); continue;
+		case '{': break;
+		default: return n;
+		}
+
+		/* {m}, {m,} and {m,n}: copies of the operand, shared in the tree */
+		len = 0;
+		if (sscanf(r->p, "{%d%n", &min, &len) != 1)
+			re_fail(r, "invalid repetition");
+		r->p += len;
+		max = min;
+		if (*r->p == ',') {
+			r->p++;
+			max = -1;
+			if (*r->p != '}') {
+				len = 0;
+				if (sscanf(r->p, "%d%n", &max, &len) != 1)
+					re_fail(r, "invalid repetition");
+				r->p += len;
+			}
+		}
+		if (*r->p++ != '}' || min < 0 || min > MAX_REPEAT || max > MAX_REPEAT
+		    || (max >= 0 && max < min))
+			re_fail(r, "invalid repetition");
+
+		rep = re_new(r, RE_EMPTY, -1, -1);
+		for (i=0; i<min; i++)
+			rep = re_new(r, RE_CAT, rep, n);
+		if (max < 0)
+			rep = re_new(r, RE_CAT, rep, re_new(r, RE_STAR, n, -1));
+		for (i=min; i<max; i++)
+			rep = re_new(r, RE_CAT, rep, re_new(r, RE_QUEST, n, -1));
+		n = rep;
+	}
+}
+
+
+int re_cat(struct re *r) {
+	int n = re_new(r, RE_EMPTY, -1, -1);
+
+	while (*r->p && *r->p != '|' && *r->p != ')')
+		n = re_new(r, RE_CAT, n, re_repeat(r));
+	return n;
+}
+
+
+int re_alt(struct re *r) {
+	int n = re_cat(r);
+
+	while (*r->p == '|') {
+		r->p++;
+		n = re_new(r, RE_ALT, n, re_cat(r));
+	}
+	return n;
+}
+
+
+int nfa_new(struct re *r, int type, int out, int out1) {
+	if (r->nnfa == MAX_NFA)
+		re_fail(r, "too complex");
+
+	r->nfa[r->nnfa].type = type;
+	r->nfa[r->nnfa].out = out;
+	r->nfa[r->nnfa].out1 = out1;
+	r->nfa[r->nnfa].set = NULL;
+	r->nfa[r->nnfa].pattern = -1;
+	return r->nnfa++;
+}
+
+
+/* Thompson construction, back to front: returns the entry to reach next */
+int nfa_compile(struct re *r, int n, int next) {
+	int s, start;
+
+	switch (r->node[n].type) {
+	case RE_SET:
+		s = nfa_new(r, NFA_SET, next, -1);
+		r->nfa[s].set = r->node[n].set;
+		return s;
+	case RE_CAT:
+		return nfa_compile(r, r->node[n].a, nfa_compile(r, r->node[n].b, next));
+	case RE_ALT:
+		start = nfa_compile(r, r->node[n].a, next);
+		return nfa_new(r, NFA_SPLIT, start, nfa_compile(r, r->node[n].b, next));
+	case RE_QUEST:
+		return nfa_new(r, NFA_SPLIT, nfa_compile(r, r->node[n].a, next), next);
+	case RE_STAR:
+		s = nfa_new(r, NFA_SPLIT, -1, next);
+		r->nfa[s].out = nfa_compile(r, r->node[n].a, s);
+		return s;
+	case RE_PLUS:
+		s = nfa_new(r, NFA_SPLIT, -1, next);
+		start = nfa_compile(r, r->node[n].a, s);
+		r->nfa[s].out = start;
+		return start;
+	}
+
+	return next; /* RE_EMPTY */
+}
+
+
+/* add NFA state s and all reachable without input to the set */
+void nfa_closure(struct re *r, unsigned long long *set, int s, int *stack) {
+	int sp = 0;
+
+	stack[sp++] = s;
+	while (sp) {
+		s = stack[--sp];
+		if (set[s >> 6] & (1ULL << (s & 63)))
+			continue;
+		set[s >> 6] |= 1ULL << (s & 63);
+		if (r->nfa[s].type == NFA_SPLIT) {
+			stack[sp++] = r->nfa[s].out;
+			stack[sp++] = r->nfa[s].out1;
+		}
+	}
+}
+
+
+/*
+ * Compile exit texts and regular expressions into one DFA. State 0 is the
+ * start, every state includes the starts of all patterns again (and of the
+ * '^' ones after a newline), that makes the search unanchored.
+ */
+void regex_build(struct matcher *m, struct pattern *p, int np) {
+	struct re *r;
+	unsigned long long *sets, *base, *base_nl, *cur;
+	int *starts, *bol, *stack, *hash;
+	unsigned int words, size = 64;
+	unsigned int d, nd = 1, h, w;
+	const char *t;
+	int i, s, c, root;
+
+	if (!(r = calloc(1, sizeof(struct re))))
+		die("Out of memory!");
+
+	starts = malloc(np * sizeof(int));
+	bol = malloc(np * sizeof(int));
+	if (!starts || !bol)
+		die("Out of memory!");
+
+	for (i=0; i<np; i++) {
+		r->text = p[i].text;
+		r->p = p[i].text;
+		bol[i] = 0;
+		if (p[i].regex) {
+			if (*r->p == '^') {
+				bol[i] = 1;
+				r->p++;
+			}
+			root = re_alt(r);
+			if (*r->p)
+				re_fail(r, "unbalanced )");
+		} else {
+			root = re_new(r, RE_EMPTY, -1, -1);
+			for (t=p[i].text; *t; t++) {
+				s = re_new(r, RE_SET, -1, -1);
+				SET_ADD(r->node[s].set, (unsigned char)*t);
+				root = re_new(r, RE_CAT, root, s);
+			}
+		}
+		s = nfa_new(r, NFA_MATCH, -1, -1);
+		r->nfa[s].pattern = i;
+		starts[i] = nfa_compile(r, root, s);
+	}
+
+	words = (r->nnfa + 63) / 64;
+	stack = malloc(2 * (r->nnfa + 1) * sizeof(int));
+	hash = malloc(2 * MAX_DFA_STATES * sizeof(int));
+	sets = malloc((size_t)size * words * sizeof(unsigned long long));
+	base = calloc(2 * words, sizeof(unsigned long long));
+	m->next = calloc((size_t)size * ALPHABET, sizeof(unsigned int));
+	m->match = malloc(size * sizeof(int));
+	if (!stack || !hash || !sets || !base || !m->next || !m->match)
+		die("Out of memory!");
+	base_nl = base + words;
+
+	for (i=0; i<np; i++) {
+		if (!bol[i])
+			nfa_closure(r, base, starts[i], stack);
+		nfa_closure(r, base_nl, starts[i], stack);
+	}
+
+	for (i=0; i<2*MAX_DFA_STATES; i++)
+		hash[i] = -1;
+
+	/* the start of the input is a line start */
+	memcpy(sets, base_nl, words * sizeof(unsigned long long));
+	for (s=0; s<r->nnfa; s++) {
+		if (r->nfa[s].type == NFA_MATCH && (sets[s >> 6] & (1ULL << (s & 63)))) {
+			r->text = p[r->nfa[s].pattern].text;
+			re_fail(r, "matches the empty string");
+		}
+	}
+
+	for (d=0; d<nd; d++) {
+		m->match[d] = -1;
+		for (s=0; s<r->nnfa; s++) {
+			if (r->nfa[s].type == NFA_MATCH && (sets[d*words + (s >> 6)] & (1ULL << (s & 63)))
+			    && (m->match[d] < 0 || r->nfa[s].pattern < m->match[d]))
+				m->match[d] = r->nfa[s].pattern;
+		}
+		if (m->match[d] >= 0)
+			continue; /* the scan stops here */
+
+		for (c=0; c<ALPHABET; c++) {
+			if (nd == size) {
+				size *= 2;
+				sets = realloc(sets, (size_t)size * words * sizeof(unsigned long long));
+				m->next = realloc(m->next, (size_t)size * ALPHABET * sizeof(unsigned int));
+				m->match = realloc(m->match, size * sizeof(int));
+				if (!sets || !m->next || !m->match)
+					die("Out of memory!");
+			}
+
+			/* successor, built in the slot of a new state */
+			cur = sets + (size_t)nd * words;
+			memcpy(cur, (c == '\n') ? base_nl : base, words * sizeof(unsigned long long));
+			for (s=0; s<r->nnfa; s++) {
+				if (r->nfa[s].type == NFA_SET && (sets[d*words + (s >> 6)] & (1ULL << (s & 63)))
+				    && SET_HAS(r->nfa[s].set, c))
+					nfa_closure(r, cur, r->nfa[s].out, stack);
+			}
+
+			h = 2166136261u;
+			for (w=0; w<words; w++)
+				h = (h ^ (unsigned int)(cur[w] ^ (cur[w] >> 32))) * 16777619u;
+			for (h %= 2*MAX_DFA_STATES; hash[h] >= 0; h = (h+1) % (2*MAX_DFA_STATES)) {
+				if (!memcmp(sets + (size_t)hash[h] * words, cur, words * sizeof(unsigned long long)))
+					break;
+			}
+
+			if (hash[h] < 0) {
+				if (nd == MAX_DFA_STATES)
+					die("exit conditions too complex (too many DFA states)");
+				memset(m->next + (size_t)nd * ALPHABET, 0, ALPHABET * sizeof(unsigned int));
+				hash[h] = nd++;
+			}
+			m->next[d*ALPHABET + c] = hash[h];
+		}
+	}
+
+	m->nstates = nd;
+
+	free(r);
+	free(starts);
+	free(bol);
+	free(stack);
+	free(hash);
+	free(sets);
+	free(base);
+}
+
+
+/*
+ * send 'cmdline' only if it is not empty.
+ * This allows for just waiting for a string without sending anything.
+ */
+void send_command(const char *cmdline) {
+	if (strlen(cmdline) != 0) {
+		pace_write(&pace, dut_con, cmdline, strlen(cmdline));
+		pace_write(&pace, dut_con, "\n", strlen("\n"));
+		if (cc) {
+			write(ccfile, cmdline, strlen(cmdline));
+			write(ccfile, "\n", strlen("\n"));
+		}
+	}
+}
+
+
+/*
+ * Scan input for exit sequence until match or timeout.
+ * ppoll() waits for input until an absolute deadline, so time spent
+ * reading and matching counts too and the timeout does not drift.
+ * The input is read in chunks of what has arrived, so an exit text is
+ * still seen right when its last byte comes in. Everything up to the end
+ * of the exit text goes to the logfile. Input behind it is kept for the
+ * next call with 'keep' set (script mode), else it is dropped like the
+ * TCSAFLUSH of the next run would do.
+ *
+ * All exit texts are matched at once by the automaton (see
+ * matcher_build()); its state carries a partial match over from one
+ * chunk to the next, there is nothing to rescan.
+ *
+ * Returns the exit code of the exit text seen, RETURN_TIMEOUT or
+ * RETURN_ERROR.
+ */
+int expect(struct matcher *m, struct pattern *patterns, int npatterns,
+		unsigned int timeout_arg, int keep) {
+	char buf[BUFLEN];
+	char msg[MAX_CONFIG_LEN];
+	long long deadline;
+	long long left;
+	struct timespec ts;
+	struct pollfd pfd;
+	unsigned int state = 0;
+	ssize_t readlen;
+	ssize_t used;
+	int ready;
+	int found;
+	int margin;
+
+	deadline = now_ns() + (long long)timeout_arg * NS_PER_MS;
+	pfd.fd = dut_con;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		if (npending) {
+			memcpy(buf, pending, npending);
+			readlen = npending;
+			npending = 0;
+		} else {
+			left = deadline - now_ns();
+			if (left < 0)
+				left = 0;
+			ts.tv_sec = left / 1000000000LL;
+			ts.tv_nsec = left % 1000000000LL;
+
+			ready = ppoll(&pfd, 1, &ts, NULL);
+			if (ready < 0 && errno == EINTR)
+				continue;
+
+			readlen = 0;
+			if (ready > 0)
+				readlen = read(dut_con, buf, sizeof(buf));
+
+			if (ready < 0 || (readlen < 0 && errno != EAGAIN && errno != EINTR)
+			    || (readlen == 0 && (pfd.revents & (POLLHUP | POLLERR)))) {
+				printf("ERROR reading from %s\n", dut_name);
+				return RETURN_ERROR;
+			} else if (readlen <= 0) {
+				if (ready > 0)
+					continue;
+				if (cc && show_timeout && npatterns) {
+					sprintf(msg, "\n======== TIMEOUT! (%dms) ========\n", timeout_arg);
+					write(ccfile, msg, strlen(msg));
+				}
+				return RETURN_TIMEOUT;
+			}
+		}
+
+		found = -1;
+		used = readlen;
+		if (npatterns)
+			used = matcher_scan(m, &state, buf, readlen, &found);
+
+		if (cc) write(ccfile, buf, used);
+
+		if (found >= 0) {
+			if (keep) {
+				npending = readlen - used;
+				memcpy(pending, buf + used, npending);
+			}
+			if (cc && show_timeout_usage) {
+				left = deadline - now_ns();
+				if (left < 0)
+					left = 0;
+				margin = timeout_arg ? (int)(left * 100 / NS_PER_MS / timeout_arg) : 0;
+				sprintf(msg, "\n-------- Timeout info: %lld.%03lldms left (of %dms) -------- %s\n", left / NS_PER_MS, left % NS_PER_MS / 1000, timeout_arg, margin<MIN_MARGIN?MARGIN_WARN:"");
+				write(ccfile, msg, strlen(msg));
+			}
+			return patterns[found].code;
+		}
+	}
+}
+
+
+/* one line of a script */
+struct step {
+	char *cmd;
+	char *text;		/* NULL: wait for the timeout */
+	unsigned int timeout;
+	unsigned int line;
+};
+
+
+/*
+ * Script mode: read all steps, then run them over the device opened and
+ * configured once. With depth > 1 commands are sent ahead, the responses
+ * are matched in order.
+ */
+int run_script(const char *name, unsigned int timeout_arg, unsigned int depth,
+		unsigned int verbose) {
+	FILE *f;
+	struct step *steps = NULL;
+	struct step *st;
+	struct pattern p;
+	struct matcher m;
+	size_t nsteps = 0, size = 0;
+	size_t cur, sent = 0;
+	char *l = NULL;
+	size_t lsize = 0;
+	ssize_t len;
+	unsigned int lineno = 0;
+	unsigned int arglen;
+	char *t;
+	long long t0;
+	int ret = RETURN_MATCH;
+	char msg[MAX_CONFIG_LEN];
+
+	f = strcmp(name, "-") ? fopen(name, "r") : stdin;
+	if (!f)
+		die("could not open script");
+
+	while ((len = getline(&l, &lsize, f)) != -1) {
+		lineno++;
+		while (len && (l[len-1] == '\n' || l[len-1] == '\r'))
+			l[--len] = 0;
+		if (len == 0 || l[0] == '#')
+			continue;
+
+		if (nsteps == size) {
+			size = size ? size*2 : 64;
+			steps = realloc(steps, size * sizeof(struct step));
+			if (!steps)
+				die("Out of memory!");
+		}
+
+		st = &steps[nsteps++];
+		st->line = lineno;
+		st->timeout = timeout_arg;
+		st->text = NULL;
+		if (!(st->cmd = strdup(l)))
+			die("Out of memory!");
+
+		if ((t = strchr(st->cmd, '\t')) != NULL) {
+			*t++ = 0;
+			st->text = t;
+			if ((t = strchr(t, '\t')) != NULL) {
+				*t++ = 0;
+				arglen = 0;
+				if (sscanf(t, "%u%n", &st->timeout, &arglen) != 1 || arglen != strlen(t)) {
+					sprintf(msg, "invalid timeout in script line %u", lineno);
+					die(msg);
+				}
+			}
+			if (!strlen(st->text))
+				st->text = NULL;
+		}
+	}
+
+	free(l);
+	if (f != stdin)
+		fclose(f);
+
+	for (cur=0; cur<nsteps; cur++) {
+		while (sent < nsteps && sent - cur < depth)
+			send_command(steps[sent++].cmd);
+
+		st = &steps[cur];
+		if (st->text) {
+			p.text = st->text;
+			p.code = RETURN_MATCH;
+			p.regex = 0;
+			matcher_build(&m, &p, 1);
+		}
+
+		t0 = now_ns();
+		ret = expect(&m, &p, st->text ? 1 : 0, st->timeout, 1);
+		if (st->text)
+			matcher_free(&m);
+		else if (ret == RETURN_TIMEOUT)
+			ret = RETURN_MATCH;
+
+		if (verbose)
+			printf("line %u: %s (%lld ms)\n", st->line,
+				ret == RETURN_MATCH ? "ok" : "failed",
+				(now_ns() - t0) / NS_PER_MS);
+
+		if (ret != RETURN_MATCH) {
+			printf("%s in script line %u: %s\n",
+				ret == RETURN_TIMEOUT ? "TIMEOUT" : "ERROR",
+				st->line, st->cmd);
+			break;
+		}
+	}
+
+	for (cur=0; cur<nsteps; cur++)
+		free(steps[cur].cmd);
+	free(steps);
+
+	return ret;
+}
+
+
+/* socket of the server of a device, e.g. /tmp/capture-1000_dev_ttyUSB0 */
+void socket_name(char *name, size_t size, const char *device) {
+	char *s;
+
+	if (snprintf(name, size, SOCKET_FMT, (unsigned int)getuid(), device) >= size)
+		die("device name too long for a socket");
+	for (s = strchr(name, '-') + 1; *s; s++)
+		if (*s == '/')
+			*s = '_';
+}
+
+
+void socket_atexit(void) {
+	if (!served)
+		unlink(sockname);
+}
+
+
+void server_stop(int sig) {
+	stop = 1;
+}
+
+
+/*
+ * Thin client: hand the command line to the server of the device and pass
+ * its output through. The request is the working directory, the number of
+ * arguments and the arguments, each NUL terminated. The server answers
+ * with the output, the last byte is the exit status.
+ *
+ * Returns the exit status, -1 if there is no server of this user (direct
+ * mode).
+ */
+int client(const char *device, int argc, char *argv[]) {
+	struct sockaddr_un sa;
+	struct ucred cred;
+	socklen_t credlen = sizeof(cred);
+	char buf[BUFLEN];
+	char *req;
+	size_t len, size, off;
+	ssize_t n;
+	int held = -1;
+	int fd, i;
+	char c;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	socket_name(sa.sun_path, sizeof(sa.sun_path), device);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* anyone may bind the name in /tmp first, talk to our own server only */
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) < 0 ||
+	    cred.uid != getuid()) {
+		close(fd);
+		return -1;
+	}
+
+	size = PATH_MAX + 16;
+	for (i=1; i<argc; i++)
+		size += strlen(argv[i]) + 1;
+	if (size > MAX_REQUEST)
+		die("command line too long for the server");
+	if (!(req = malloc(size)))
+		die("Out of memory!");
+
+	if (!getcwd(req, PATH_MAX))
+		strcpy(req, "/");
+	len = strlen(req) + 1;
+	len += sprintf(req + len, "%d", argc - 1) + 1;
+	for (i=1; i<argc; i++) {
+		strcpy(req + len, argv[i]);
+		len += strlen(argv[i]) + 1;
+	}
+
+	for (off=0; off < len; off += n)
+		if ((n = write(fd, req + off, len - off)) < 0)
+			break;
+	free(req);
+	shutdown(fd, SHUT_WR);
+
+	/* hold the last byte back, it may be the exit status */
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		if (held >= 0) {
+			c = held;
+			write(STDOUT_FILENO, &c, 1);
+		}
+		write(STDOUT_FILENO, buf, n - 1);
+		held = (unsigned char)buf[n-1];
+	}
+	close(fd);
+
+	if (held < 0)
+		die("no answer from the capture server");
+
+	return held;
+}
+
+
+int run(int argc, char* argv[]);
+
+/*
+ * Server mode: the device is opened and configured once, then each
+ * request of a client runs in a child with the output sent back to the
+ * client. The child parses the command line like a direct call does, but
+ * skips the config file and the device setup. Requests are taken one at a
+ * time, a device has one conversation at a time anyway.
+ */
+int run_server(const char *device, unsigned int verbose) {
+	struct sockaddr_un sa;
+	struct sigaction act;
+	char **args;
+	char *req, *p, *end;
+	size_t len;
+	ssize_t n;
+	int lfd, conn, nargs, status, i;
+	pid_t pid;
+	mode_t mask;
+	char c;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	socket_name(sa.sun_path, sizeof(sa.sun_path), device);
+
+	if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		die("could not create socket");
+
+	/* a socket left over by a server gone refuses the connection */
+	if (connect(lfd, (struct sockaddr *)&sa, sizeof(sa)) == 0)
+		die("a server is running for this device already");
+	unlink(sa.sun_path);
+
+	close(lfd);
+	if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		die("could not create socket");
+
+	mask = umask(077);
+	if (bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		die("could not bind socket");
+	umask(mask);
+
+	strcpy(sockname, sa.sun_path);
+	if (atexit(socket_atexit) != 0)
+		die("atexit: can't register socket removal");
+
+	if (listen(lfd, SOMAXCONN) < 0)
+		die("could not listen on socket");
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = server_stop;	/* no SA_RESTART, accept() returns */
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (verbose)
+		printf("serving %s on %s\n", device, sa.sun_path);
+	fflush(stdout);
+
+	if (!(req = malloc(MAX_REQUEST)))
+		die("Out of memory!");
+
+	while (!stop) {
+		if ((conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			die("could not accept a client");
+		}
+
+		for (len = 0; len < MAX_REQUEST; len += n) {
+			n = read(conn, req + len, MAX_REQUEST - len);
+			if (n < 0 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			if (n <= 0)
+				break;
+		}
+
+		/* working directory, number of arguments, arguments */
+		end = req + len;
+		p = memchr(req, 0, len);
+		nargs = -1;
+		if (p && memchr(p + 1, 0, end - p - 1) && sscanf(p + 1, "%d", &nargs) != 1)
+			nargs = -1;
+		args = (nargs >= 0 && nargs < MAX_REQUEST) ? malloc((nargs + 2) * sizeof(char *)) : NULL;
+		if (args) {
+			p += strlen(p + 1) + 2;
+			args[0] = "capture";
+			for (i=1; i<=nargs && p < end && memchr(p, 0, end - p); i++) {
+				args[i] = p;
+				p += strlen(p) + 1;
+			}
+			args[i] = NULL;
+			if (i <= nargs) {
+				free(args);
+				args = NULL;
+			}
+		}
+		if (!args) {
+			close(conn);
+			continue;
+		}
+
+		if ((pid = fork()) == 0) {
+			served = 1;
+			close(lfd);
+			dup2(conn, STDOUT_FILENO);
+			close(conn);
+			if (chdir(req) < 0)
+				die("could not change to the working directory of the client");
+			exit(run(nargs + 1, args));
+		}
+
+		status = RETURN_ERROR << 8;
+		if (pid > 0) {
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+				;
+		}
+		c = WIFEXITED(status) ? WEXITSTATUS(status) : RETURN_ERROR;
+		write(conn, &c, 1);
+		close(conn);
+		free(args);
+	}
+
+	free(req);
+	close(lfd);
+	return RETURN_MATCH;
+}
+
+
+int run(int argc, char* argv[]) {
 	unsigned int arglen;
 	unsigned int timeout_arg = 1000;
-	unsigned int timeout_val = 0;
-	unsigned int timeout_loop = 1;
 	unsigned int verbose = 0;
-	char *exit_text = NULL;
+	unsigned int depth = 1;
+	struct pattern patterns[MAX_PATTERNS];
+	int npatterns = 0;
+	struct matcher matcher;
 	char *cmdline = NULL;
+	char *script = NULL;
 	char *device = DEVICE_DEFAULT;
-	char *hide_text = NULL;
+	int server = 0;
+	int ret;
 	unsigned int n;
-	unsigned int hide_idx = 0;
-	int ret = RETURN_ERROR;
-	char c;
 	char line[MAX_CONFIG_LEN];
 	char *config_name;
 	char *match;
 	char *s;
 	const char *homedir;
 	char ccfilename[MAX_CONFIG_LEN];
-	unsigned int chardelay = 0;
-	unsigned int show_timeout = 0;
-	unsigned int show_timeout_usage = 0;
-	char msg[MAX_CONFIG_LEN];
-	int margin;
-	ssize_t readlen;
 #if DEBUG
 	short unsigned int port;
 #endif
 
+	/* a served request keeps the pacing of the server's configuration */
+	if (!served)
+		pace_init(&pace, 0, 0, 0);
 
 	if (argc == 1) {
 		usage(argv[0]);
@@ -194,13 +1278,66 @@ int main(int argc, char* argv[]) {
 			n++;
 			device = argv[n];
 		} else
-		if (strncmp(argv[n], ARG_EXITTEXT, strlen(argv[n])) == 0) {
+		if (strncmp(argv[n], ARG_EXITTEXT, strlen(argv[n])) == 0
+		    || strncmp(argv[n], ARG_REGEX, strlen(argv[n])) == 0) {
 			if (argc <= (n+1)) {
 				printf("missing exit text");
 				usage(argv[0]);
 			}
+			if (npatterns == MAX_PATTERNS)
+				die("too many exit texts");
+			patterns[npatterns].regex = (strcmp(argv[n], ARG_REGEX) == 0);
 			n++;
-			exit_text = argv[n];
+			patterns[npatterns].text = argv[n];
+			patterns[npatterns++].code = RETURN_MATCH;
+		} else
+		if (strncmp(argv[n], ARG_MATCH, strlen(argv[n])) == 0
+		    || strncmp(argv[n], ARG_REGEXCODE, strlen(argv[n])) == 0) {
+			if (argc <= (n+1)) {
+				printf("missing exit code and text");
+				usage(argv[0]);
+			}
+			if (npatterns == MAX_PATTERNS)
+				die("too many exit texts");
+			patterns[npatterns].regex = (strcmp(argv[n], ARG_REGEXCODE) == 0);
+			n++;
+			arglen = 0;
+			if (sscanf(argv[n], "%i:%n", &patterns[npatterns].code, &arglen) != 1
+			    || arglen == 0) {
+				printf("invalid exit code, use code:exit_text");
+				usage(argv[0]);
+			}
+			if (patterns[npatterns].code == RETURN_TIMEOUT
+			    || patterns[npatterns].code == RETURN_ERROR
+			    || patterns[npatterns].code < 0 || patterns[npatterns].code > 255)
+				die("exit code must be 0..255, but not 1 (timeout) or 2 (error)");
+			patterns[npatterns++].text = argv[n] + arglen;
+		} else
+		if (strncmp(argv[n], ARG_SCRIPT, strlen(argv[n])) == 0) {
+			if (argc <= (n+1)) {
+				printf("missing script name");
+				usage(argv[0]);
+			}
+			n++;
+			script = argv[n];
+		} else
+		if (strncmp(argv[n], ARG_PIPELINE, strlen(argv[n])) == 0) {
+			if (argc <= (n+1)) {
+				printf("missing pipeline depth");
+				usage(argv[0]);
+			}
+			arglen = 0;
+			sscanf(argv[n+1], "%u%n", &depth, &arglen);
+			if (arglen != strlen(argv[n+1]) || depth == 0) {
+				printf("invalid pipeline depth");
+				usage(argv[0]);
+			}
+			n++;
+		} else
+		if (strncmp(argv[n], ARG_SERVER, strlen(argv[n])) == 0) {
+			if (served)
+				die("a request cannot start a server");
+			server = 1;
 		} else
 		if (strncmp(argv[n], ARG_VERBOSE, strlen(argv[n])) == 0) {
 			verbose = 1;
@@ -214,16 +1351,39 @@ int main(int argc, char* argv[]) {
 			cmdline = argv[n];
 	}
 
-	if (!cmdline)
+	if (!cmdline && !script && !server)
 		die("no command line given");
 
-	if (verbose) {
-		printf("command: %s\n", cmdline);
+	/* a server of the device runs it, the script on stdin stays here */
+	if (!served && !server && !(script && strcmp(script, "-") == 0)) {
+		if ((ret = client(device, argc, argv)) >= 0)
+			return ret;
+	}
+
+	if (verbose && !server) {
+		if (script)
+			printf("script: %s (depth %u)\n", script, depth);
+		else
+			printf("command: %s\n", cmdline);
 		printf("device: %s\n", device);
-		printf("exit text: %s\n", exit_text?exit_text:"None");
+		if (!npatterns)
+			printf("exit text: None\n");
+		for (n=0; n<npatterns; n++)
+			printf("exit %s: %s (exit code %d)\n", patterns[n].regex ? "regex" : "text", patterns[n].text, patterns[n].code);
 		printf("timeout: %d ms\n", timeout_arg);
 	}
 
+	for (n=0; n<npatterns; n++) {
+		if (!strlen(patterns[n].text))
+			die("empty exit text");
+	}
+
+	if (served) {
+		/* device set up by the server, drop the input before the request */
+		tcflush(dut_con, TCIFLUSH);
+		goto request;
+	}
+
 	/*
 	 * read configuration file, if it exists
 	 */
@@ -267,6 +1427,8 @@ int main(int argc, char* argv[]) {
 			if ((match = strstr(&line[0], CHAR_DELAY_TAG)) != 0) {
 				//printf("line: %s\n", match);
 				if (sscanf(match + strlen(CHAR_DELAY_TAG), "%d", &chardelay) == 1) {
+					// one character per write, with the delay behind it
+					pace_init(&pace, 0, 1, chardelay);
 					if (verbose)
 						printf("setting delay to %d milliseconds\n", chardelay);
 				} else
@@ -275,6 +1437,17 @@ int main(int argc, char* argv[]) {
 				continue;
 			}
 
+			// check for pacing: bytes/s, burst and gap between writes
+			if ((match = strstr(&line[0], PACE_TAG)) != 0) {
+				if (pace_parse(&pace, match + strlen(PACE_TAG)) == 0) {
+					if (verbose)
+						printf("pacing writes: %s", match + strlen(PACE_TAG));
+				} else
+					if (verbose)
+						printf("Invalid pace setting\n");
+				continue;
+			}
+
 			// check for showing timeouts if logging is enabled
 			if ( cc && ((match = strstr(&line[0], TIMEOUT_TAG)) != 0)) {
 				//printf("line: %s\n", match);
@@ -303,6 +1476,7 @@ int main(int argc, char* argv[]) {
 		//printf("no config file found\n");
 	}
 
+	dut_name = device;
 	dut_con = open(device, O_RDWR);
 
 	if (dut_con == -1)
@@ -311,25 +1485,6 @@ int main(int argc, char* argv[]) {
 	if (! isatty(dut_con))
 		die("not on a tty");
 
-	if (exit_text) {
-		hide_text = malloc(strlen(exit_text)+1);
-		if (!hide_text)
-			die("Out of memory!");
-		hide_text[strlen(exit_text)] = 0;
-	}
-
-	/* check timeout granularity; must be n*TIMEOUT_GRANULARITY */
-	if (timeout_arg % TIMEOUT_GRANULARITY) {
-		sprintf(msg, "Invalid timeout granularity. Must be a multiple of %dms\n", TIMEOUT_GRANULARITY);
-		die(msg);
-	}
-
-	/* calculate counter for timeout loop */
-	if (timeout_arg >= TIMEOUT_GRANULARITY) {
-		timeout_loop = timeout_arg/TIMEOUT_GRANULARITY;
-		timeout_val = TIMEOUT_GRANULARITY;
-	}
-
 	/* store current tty settings in orig_termios */
 	if (tcgetattr(dut_con, &orig_termios) < 0)
 		die("can't get tty settings");
@@ -339,101 +1494,29 @@ int main(int argc, char* argv[]) {
 		die("atexit: can't register tty reset");
 
 
-	tty_raw(dut_con, timeout_val);
+	tty_raw(dut_con);
 
-	/*
-	 * send 'cmdline' only if it is not empty.
-	 * This allows for just waiting for a string without sending anything.
-	 */
-	if (strlen(cmdline) != 0) {
-		if (chardelay) {
-			int i;
-			for (i=0; i<strlen(cmdline); i++) {
-				write(dut_con, &cmdline[i], 1);
-				usleep(chardelay*1000);
-			}
-			usleep(chardelay*1000);
-			write(dut_con, "\n", strlen("\n"));
-		} else {
-			write(dut_con, cmdline, strlen(cmdline));
-			write(dut_con, "\n", strlen("\n"));
-		}
-		if (cc) {
-			write(ccfile, cmdline, strlen(cmdline));
-			write(ccfile, "\n", strlen("\n"));
-		}
-	}
+	if (server)
+		return run_server(device, verbose);
 
-	/*
-	 * Scan input for exit sequence until match or timeout.
-	 * Every character which is not part of the exit sequence shall be
-	 * printed on stdout.
-	 * If one or more characters match the exit sequence, they will be
-	 * copied to a separate buffer (hide_text) because the exit sequence
-	 * shall not be printed. If there is finally a mismatch, the buffer is
-	 * scanned bytewise if there could be another match.
-	 *
-	 * Example: exit sequence is "abac" and input is "ababac"
-	 * Receiving the first character 'a' is a match and stored in hide_text.
-	 * The same is true for 'b' and 'a'. The next input character 'b'
-	 * invalidates hide_text. But hide_text (which is "abab" now) must not
-	 * be thrown away (i.e. printed) completely, but only the first two
-	 * chars because the third and fourth character again match the exit
-	 * sequence. This rematching of the hide_text buffer is done in
-	 * rematch() (surprise!)
-	 * It returns the number of characters in hide_text which still match
-	 * the exit sequence. In the example above, rematch returns 2 and
-	 * hide_text contains "ab" then.
-	 */
-	for (;;) {
-		readlen = read(dut_con, &c, 1);
-		if (readlen < 0) {
-			printf("ERROR reading from %s\n", device);
-			ret = RETURN_ERROR;
-			break;
-		} else if (readlen == 0) {
-			if (--timeout_loop)
-				continue;
-			//write(STDOUT_FILENO, hide_text, hide_idx);
-			if (cc) write(ccfile, hide_text, hide_idx);
-			if (cc && show_timeout && exit_text) {
-				sprintf(msg, "\n======== TIMEOUT! (%dms) ========\n", timeout_arg);
-				write(ccfile, msg, strlen(msg));
-			}
-			ret = RETURN_TIMEOUT;
-			break;
-		} else {
-			if (exit_text) {
-				if (c == exit_text[hide_idx]) {
-					hide_text[hide_idx++] = c;
-					if (hide_idx == strlen(exit_text)) {
-						//c='\n';
-						//write(STDOUT_FILENO, &c, 1);
-						if (cc) write(ccfile, hide_text, strlen(exit_text));
-						if (cc && show_timeout_usage) {
-							margin = timeout_loop*TIMEOUT_GRANULARITY*100 / timeout_arg;
-							sprintf(msg, "\n-------- Timeout info: %dms left (of %dms) -------- %s\n", timeout_loop*TIMEOUT_GRANULARITY, timeout_arg, margin<MIN_MARGIN?MARGIN_WARN:"");
-							write(ccfile, msg, strlen(msg));
-						}
-						ret = RETURN_MATCH;
-						break;
-					}
-				}
-				else {
-					if (hide_idx) {
-						hide_text[hide_idx++] = c;
-						hide_idx = rematch(exit_text, hide_text, hide_idx);
-					} else {
-						//write(STDOUT_FILENO, &c, 1);
-						if (cc) write(ccfile, &c, 1);
-					}
-				}
-			} else {
-				//write(STDOUT_FILENO, &c, 1);
-				if (cc) write(ccfile, &c, 1);
-			}
-		}
-	}
+request:
+	if (script)
+		return run_script(script, timeout_arg, depth, verbose);
 
-	return ret;
+	for (n=0; n<npatterns && !patterns[n].regex; n++)
+		;
+	if (n < npatterns)
+		regex_build(&matcher, patterns, npatterns);
+	else if (npatterns)
+		matcher_build(&matcher, patterns, npatterns);
+
+	send_command(cmdline);
+
+	return expect(&matcher, patterns, npatterns, timeout_arg, 0);
 }
+
+
+int main(int argc, char* argv[]) {
+	return run(argc, argv);
+}
+
@@ -26,9 +26,13 @@
 
 
 #define NAME_SIZE 80
+#define KERNEL_REPORT_SIZE ( 1024*1024 )
+#define DUMP_COLS          ( 16 )
+#define DUMP_GROUP         ( 2 )
 
 
 const char *stdin_filename = "standard input";
+const char *stdin_argv[] = { stdin_filename, NULL }; // hcat() list is NULL ended
 FILE *target_file;
 
   
@@ -47,16 +51,25 @@ static void usage( const char *program_name )
   printf( " -h : Print this help.\n" );
   printf( " -i : Ignore EOF (terminate with CTRL+C).\n" );
   printf( " -A : Translate to a HEX represenation of input ASCII sequence.\n" );
+  printf( " -S : With -A skip whitespace, linefeeds and 0x prefixes.\n" );
   printf( " -H : Translate HEX to ASCII.\n" );
+  printf( " -D : Formatted hexdump with offset and ASCII column.\n" );
+  printf( " -c <n> : Hexdump bytes per line (default %i).\n", DUMP_COLS );
+  printf( " -g <n> : Hexdump group width 1, 2, 4 or 8 (default %i).\n",
+          DUMP_GROUP );
+  printf( " -e : Hexdump groups as little endian words.\n" );
+  printf( " -O : Hexdump without offset column.\n" );
+  printf( " -P : Hexdump without ASCII column.\n" );
+  printf( " -K : Report HEX codec kernel throughput and exit.\n" );
   printf( " -v : Show options when executed.\n" );
   printf( "\n" );
 }
 
 
 #ifdef LINUX
-  #define OPTSTR "+f:hiAHv"
+  #define OPTSTR "+f:hiAHKSvDc:g:eOP"
 #else
-  #define OPTSTR "f:hiAHv"
+  #define OPTSTR "f:hiAHKSvDc:g:eOP"
 #endif
 
 int main( int argc, char **argv )
@@ -66,9 +79,13 @@ int main( int argc, char **argv )
   int verbose = 0;          // verbose mode
   int help = 0;             // print program help
   int ieof = 0;             // ignore EOF
-  int a2h, h2a = 0;         // ASCII/HEX translation
+  int a2h = 0, h2a = 0;     // ASCII/HEX translation
   int i = 0;                // an index
   int exp = 0;              // explicit file mode
+  int kreport = 0;          // report codec kernel throughput
+  int skip = 0;             // skip separators on ASCII to HEX
+  int dump = 0;             // formatted hexdump
+  tHexdump_fmt fmt;         // hexdump layout
   int c;                    // option parser character
   const char *pname = argv[0];
   char *target = NULL;      // output file name
@@ -76,6 +93,12 @@ int main( int argc, char **argv )
   
   target_file = NULL;
 
+  fmt.cols = DUMP_COLS;
+  fmt.group = DUMP_GROUP;
+  fmt.swap = 0;
+  fmt.offset = 1;
+  fmt.ascii = 1;
+
   opterr = 0;               // from: unistd()
   while ( EOF != (c = getopt( argc, argv, OPTSTR)) )
   {
@@ -87,19 +110,40 @@ int main( int argc, char **argv )
       case 'i' : ieof = 1;                                      break;
       case 'A' : a2h = 1;                                       break;
       case 'H' : h2a = 1;                                       break;
+      case 'K' : kreport = 1;                                   break;
+      case 'S' : skip = 1;                                      break;
+      case 'D' : dump = 1;                                      break;
+      case 'c' : fmt.cols = (size_t)atoi( optarg );             break;
+      case 'g' : fmt.group = (size_t)atoi( optarg );            break;
+      case 'e' : fmt.swap = 1;                                  break;
+      case 'O' : fmt.offset = 0;                                break;
+      case 'P' : fmt.ascii = 0;                                 break;
       case '?' : err_sys( "Unrecognized option: -%c", optopt ); break;
     }
   }
 
   // Stupid users...
   if ( argc <= (optind-1) )
-    err_sys( "Usage: %s [-AHhiv -f <target file>] [infiles (stdin if none)]", argv[0] );
+    err_sys( "Usage: %s [-ADHhiSv -f <target file>] [infiles (stdin if none)]", argv[0] );
 
   if ( help == 1 ) {
     usage( pname );
     exit( 0 );
   }
 
+  if ( (a2h == 1) && (skip == 1) )
+    a2h = 2; // see hcat()
+
+  if ( (dump == 1) && ((fmt.cols < 1) || (fmt.cols > HEXDUMP_MAX_COLS)) )
+    err_quit( "Bytes per line must be 1..%i", HEXDUMP_MAX_COLS );
+
+  if ( (dump == 1) && (fmt.group != 1) && (fmt.group != 2) &&
+       (fmt.group != 4) && (fmt.group != 8) )
+    err_quit( "Group width must be 1, 2, 4 or 8" );
+
+  if ( kreport == 1 )
+    exit( hex_kernel_report( stderr, KERNEL_REPORT_SIZE ) ? 1 : 0 );
+
   if ( 0 > atexit( cleanup ) )
     err_sys( "Cannot install the exit-handler for streams" );
 
@@ -127,7 +171,7 @@ int main( int argc, char **argv )
   */
 
   if ( (argc - optind) < 1 ) {
-    pargs = (char**)&stdin_filename;
+    pargs = (char**)stdin_argv;
   } else {
     pargs = &argv[optind];
   }
@@ -139,6 +183,7 @@ int main( int argc, char **argv )
       fprintf( stderr, " %s", pargs[i] );
     }
     fprintf( stderr, "\nTarget file FD=%i: %s\n", fdout, target );
+    fprintf( stderr, "HEX codec kernel: %s\n", hex_kernel_name() );
   }
 
   // Read from stdin if there's nothing else to do:
@@ -148,7 +193,7 @@ int main( int argc, char **argv )
   pty_buffers_atexit();
 
   do {
-    ret = hcat( fdout, pargs, a2h, h2a, verbose );
+    ret = hcat( fdout, pargs, a2h, h2a, (dump == 1) ? &fmt : NULL, verbose );
   } while ( 1 == ieof );
 
   return ( ret );
@@ -0,0 +1,213 @@
+/* vi: set sw=4 ts=4: */
+
+/*!
+ * \version  1.0.0
+ * \author   ksnguyen
+ * \date     2026-10-15   Header created. Compile-time generated translation
+ *                        tables replace the runtime search of the nibble-char
+ *                        table in pty.c.
+ *
+ * \note
+ *           Header-only HEX codec for C++ translation units (the Makefile
+ *           builds everything with g++). The tables are generated by constexpr
+ *           functions, so translating is a plain table lookup without
+ *           branches and without any allocation:
+ *
+ *             hex::nibbles         char -> nibble, hex::invalid if no digit
+ *             hex::digits<Case>    byte -> two characters
+ *
+ *           In pty.c these are the scalar kernel of snprintu8() and
+ *           u8nprints(), the reference the SSE2/AVX2 kernels chosen at startup
+ *           must match; hex::nibble_or_zero() takes the leading nibble of an
+ *           odd input there. The C ABI of both functions stays the same.
+ *
+ *           Example:
+ *
+ *             char out[3*sizeof( regs )];
+ *             n = hex::encode<hex::upper, ':'>( regs, sizeof( regs ),
+ *                                               out, sizeof( out ) );
+ */
+
+#ifndef _PTY_HEX_H
+  #define _PTY_HEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined( __cplusplus )
+
+#if __cplusplus >= 202002L
+  #include <span>
+#endif
+
+namespace hex {
+
+/*!
+ * \brief    Letter case of the digits 'a'..'f' on encoding. Decoding accepts
+ *           both cases.
+ */
+enum Case { lower, upper };
+
+
+/*!
+ * \brief    Table value of a character that is no HEX digit. Chosen as 0x10,
+ *           so nibble_or_zero() can clear it without a branch.
+ */
+static constexpr uint8_t invalid = 0x10;
+
+
+struct nibble_table { uint8_t v[256]; };
+struct digit_table  { char v[256][2]; };
+
+
+constexpr nibble_table make_nibbles( void )
+{
+  nibble_table t = {};
+  int c = 0;
+
+  for ( c=0; c<256; c++ )
+    t.v[c] = invalid;
+
+  for ( c=0; c<10; c++ )
+    t.v['0'+c] = (uint8_t)c;
+
+  for ( c=0; c<6; c++ ) {
+    t.v['a'+c] = (uint8_t)(10+c);
+    t.v['A'+c] = (uint8_t)(10+c);
+  }
+
+  return ( t );
+}
+
+
+template<Case C>
+constexpr digit_table make_digits( void )
+{
+  const char *sym = (C == upper) ? "0123456789ABCDEF" : "0123456789abcdef";
+  digit_table t = {};
+  int b = 0;
+
+  for ( b=0; b<256; b++ ) {
+    t.v[b][0] = sym[b >> 4];  // MSNibble first
+    t.v[b][1] = sym[b & 0x0F];
+  }
+
+  return ( t );
+}
+
+
+// char -> nibble (256 entries, hex::invalid marks non-digits):
+static constexpr nibble_table nibbles = make_nibbles();
+
+// byte -> two characters (256x2 entries):
+template<Case C>
+struct digits { static constexpr digit_table table = make_digits<C>(); };
+
+template<Case C>
+constexpr digit_table digits<C>::table;
+
+
+/*!
+ * \brief    Nibble value of a character, hex::invalid if it is no HEX digit.
+ */
+constexpr uint8_t nibble( char c )
+{
+  return ( nibbles.v[(uint8_t)c] );
+}
+
+
+/*!
+ * \brief    Nibble value of a character. Characters not in range ['0'..'9',
+ *           'a'..'f', 'A'..'F'] are translated to 0x00.
+ */
+constexpr uint8_t nibble_or_zero( char c )
+{
+  // (0x10 >> 4) - 1 clears the invalid marker, 0x0F keeps valid nibbles:
+  return ( nibble( c ) & (uint8_t)((nibble( c ) >> 4) - 1) );
+}
+
+
+/*!
+ * \brief    Translate bytes to HEX characters, MSNibble first. With a
+ *           Separator other than '\0', it is put between two bytes.
+ * \param    [IN]  *in           Bytes to translate.
+ * \param    [IN]  in_num        Number of bytes.
+ * \param    [OUT] *out          Character buffer.
+ * \param    [IN]  out_size      Size of the character buffer. Translation is
+ *                               truncated to whole bytes fitting in.
+ * \return   Number of characters written to *out.
+ */
+template<Case C = lower, char Separator = '\0'>
+size_t encode( const uint8_t *in, size_t in_num, char *out, size_t out_size )
+{
+  const digit_table &t = digits<C>::table;
+  const size_t width = (Separator == '\0') ? 2 : 3;
+  size_t i, n = in_num;
+  char *o = out;
+
+  if ( (Separator != '\0') && (out_size > 0) )
+    out_size++; // no separator behind the last byte
+
+  if ( out_size < n*width )
+    n = out_size/width;
+
+  for ( i=0; i<n; i++ ) {
+    if ( (Separator != '\0') && (i > 0) )
+      *o++ = Separator;
+
+    *o++ = t.v[in[i]][0];
+    *o++ = t.v[in[i]][1];
+  }
+
+  return ( (size_t)(o - out) );
+}
+
+
+/*!
+ * \brief    Translate pairs of HEX characters to bytes, MSNibble first.
+ *           Characters which are no HEX digit are translated to 0x00.
+ * \param    [IN]  *in           Characters to translate.
+ * \param    [IN]  in_size       Number of characters. An odd last character
+ *                               is left alone.
+ * \param    [OUT] *out          Byte buffer.
+ * \param    [IN]  out_size      Size of the byte buffer. Translation is
+ *                               truncated to out_size.
+ * \return   Number of bytes written to *out.
+ */
+inline size_t decode( const char *in, size_t in_size, uint8_t *out,
+                      size_t out_size )
+{
+  size_t i, n = in_size/2;
+
+  if ( out_size < n )
+    n = out_size;
+
+  for ( i=0; i<n; i++ )
+    out[i] = (uint8_t)((nibble_or_zero( in[2*i] ) << 4) |
+                       nibble_or_zero( in[2*i+1] ));
+
+  return ( n );
+}
+
+
+#if __cplusplus >= 202002L
+template<Case C = lower, char Separator = '\0'>
+size_t encode( std::span<const uint8_t> in, std::span<char> out )
+{
+  return ( encode<C, Separator>( in.data(), in.size(),
+                                 out.data(), out.size() ) );
+}
+
+
+inline size_t decode( std::span<const char> in, std::span<uint8_t> out )
+{
+  return ( decode( in.data(), in.size(), out.data(), out.size() ) );
+}
+#endif
+
+} // namespace hex
+
+#endif // __cplusplus
+
+#endif // _PTY_HEX_H
+// EOF
@@ -0,0 +1,199 @@
+/* vi: set sw=4 ts=4: */
+
+/*
+ * Copyright (C) 2020
+ * Khoa Sebastian Nguyen
+ * <sebastian.nguyen@asog-central.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \brief    Checks every HEX kernel this CPU supports against the scalar one:
+ *           Encoding, decoding (with invalid characters) and the round trip,
+ *           at all misalignments of the buffers and all lengths around the
+ *           vector widths, so the heads and tails of the SIMD loops are hit.
+ *           Nothing may be written behind the output.
+ * \note     Built as one unit with pty.c to reach every kernel, not only the
+ *           one selected for this CPU (like bench.c).
+ * \return   EXIT_SUCCESS if all kernels match, EXIT_FAILURE otherwise.
+ */
+
+#include "pty.c"
+
+#define CHECK_HEADS     ( 64 )      // misalignments of in and out
+#define CHECK_MAX_LEN   ( 3*64 )    // bytes per call, beyond two AVX2 blocks
+#define CHECK_GUARD     ( 0xA5 )    // canary behind the output
+
+
+#ifdef LINUX
+  #define OPTSTR "+hv"
+#else
+  #define OPTSTR "hv"
+#endif
+
+
+/*!
+ * \brief    Characters the decoder must map like the scalar kernel does:
+ *           Digits of both cases, neighbours of the digit ranges and bytes
+ *           above 0x7F.
+ */
+static const char check_chars[] = "0123456789abcdefABCDEF"
+                                  "/:@G`gxz \n\x01\x7F\x80\xC6\xFF";
+
+
+static uint32_t check_seed = 0x2F6E2B1;
+
+
+static uint32_t _check_rand( void )
+{
+  // xorshift32, the same sequence on every run:
+  check_seed ^= check_seed << 13;
+  check_seed ^= check_seed >> 17;
+  check_seed ^= check_seed << 5;
+
+  return ( check_seed );
+}
+
+
+static int _check_guard( const uint8_t *p, size_t n )
+{
+  size_t i;
+
+  for ( i=0; i<n; i++ )
+    if ( CHECK_GUARD != p[i] )
+      return ( -1 );
+
+  return ( 0 );
+}
+
+
+/*!
+ * \brief    One kernel against the scalar kernel at one alignment and length.
+ * \return   0 if o.k, -1 on the first mismatch (reported to stderr).
+ */
+static int _check_kernel( const tHex_kernel *k, size_t head, size_t len )
+{
+  const tHex_kernel *ref = &hex_kernels[HEX_KERNELS-1];
+  static uint8_t raw[CHECK_HEADS + CHECK_MAX_LEN];
+  static char txt[CHECK_HEADS + 2*CHECK_MAX_LEN];
+  static char enc[2][CHECK_HEADS + 2*CHECK_MAX_LEN + CHECK_HEADS];
+  static uint8_t dec[2][CHECK_HEADS + CHECK_MAX_LEN + CHECK_HEADS];
+  const char *what = NULL;
+  size_t i;
+
+  for ( i=0; i<len; i++ )
+    raw[head + i] = (uint8_t)_check_rand();
+
+  for ( i=0; i<2*len; i++ )
+    txt[head + i] = check_chars[_check_rand() % (sizeof( check_chars ) - 1)];
+
+  memset( enc, CHECK_GUARD, sizeof( enc ) );
+  memset( dec, CHECK_GUARD, sizeof( dec ) );
+
+  k->encode( &enc[0][head], &raw[head], len );
+  ref->encode( &enc[1][head], &raw[head], len );
+
+  if ( (0 != memcmp( &enc[0][head], &enc[1][head], 2*len )) ||
+       (0 > _check_guard( (uint8_t*)&enc[0][head + 2*len], CHECK_HEADS )) ) {
+    what = "encode";
+    goto check_kernel_errout;
+  }
+
+  k->decode( &dec[0][head], &txt[head], len );
+  ref->decode( &dec[1][head], &txt[head], len );
+
+  if ( (0 != memcmp( &dec[0][head], &dec[1][head], len )) ||
+       (0 > _check_guard( &dec[0][head + len], CHECK_HEADS )) ) {
+    what = "decode";
+    goto check_kernel_errout;
+  }
+
+  // Round trip of the encoded bytes:
+  memset( dec[0], CHECK_GUARD, sizeof( dec[0] ) );
+  k->decode( &dec[0][head], &enc[0][head], len );
+
+  if ( 0 != memcmp( &dec[0][head], &raw[head], len ) ) {
+    what = "round trip";
+    goto check_kernel_errout;
+  }
+
+  return ( 0 );
+
+check_kernel_errout:
+  fprintf( stderr, "Kernel %s: %s differs from scalar at offset %lu, "
+           "length %lu\n", k->name, what, (unsigned long)head,
+           (unsigned long)len );
+  return ( -1 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+  int c;
+  int help = 0, verbose = 0;
+  int retval = EXIT_SUCCESS;
+  size_t k, head, len;
+  unsigned long checks;
+
+  opterr = 0;
+  while ( EOF != (c = getopt( argc, argv, OPTSTR )) ) {
+    switch ( c ) {
+      case 'h' : help = 1;    break;
+      case 'v' : verbose = 1; break;
+      case '?' : fprintf( stderr, "Unrecognized option: -%c\n", optopt );
+                 return ( EXIT_FAILURE );
+    }
+  }
+
+  if ( 1 == help ) {
+    printf( "Usage: %s [-hv]\n", argv[0] );
+    printf( "  Checks the HEX kernels of this CPU against the scalar one.\n" );
+    printf( "    -h  Print this help.\n" );
+    printf( "    -v  Report every kernel checked.\n" );
+    return ( EXIT_SUCCESS );
+  }
+
+  // The scalar kernel comes last and is the reference:
+  for ( k=0; k+1<HEX_KERNELS; k++ ) {
+    if ( ! hex_kernels[k].supported() ) {
+      if ( 1 == verbose )
+        printf( "%-8s not supported by this CPU, skipped\n",
+                hex_kernels[k].name );
+      continue;
+    }
+
+    checks = 0;
+    for ( head=0; head<CHECK_HEADS; head++ ) {
+      for ( len=0; len<=CHECK_MAX_LEN; len++, checks++ ) {
+        if ( 0 > _check_kernel( &hex_kernels[k], head, len ) ) {
+          retval = EXIT_FAILURE;
+          goto main_next_kernel; // one report per kernel is enough
+        }
+      }
+    }
+
+    if ( 1 == verbose )
+      printf( "%-8s o.k. (%lu alignments/lengths)\n", hex_kernels[k].name,
+              checks );
+
+main_next_kernel:
+    ;
+  }
+
+  return ( retval );
+}
+
+// EOF
@@ -24,8 +24,9 @@
 #include <signal.h>
 #include <time.h>
 #include "daemon.h"
+#include "server.h"
 
-#define BUFLEN              1024
+#define BUFLEN              IOBUF_DEFAULT_CAP // upper limit, buffers adapt
 #define DEFAULT_TIMEOUT     1000
 #define TIMEOUT_GRANULARITY 40
 #define POLLING_TIMEOUT     10
@@ -88,12 +89,17 @@ static void cleanup( void )
 
 
 /*!
- * \brief  Fork to child: It copies STDIN to PTS-master.
- *         Parent: It copies PTS-master to STDOUT.
+ * \brief  Copy STDIN to PTS-master and PTS-master to STDOUT in one process
+ *         (pty_loop()), until the program has ended or a signal arrives.
  * \param  [IN]  fdm          Filedescriptor of the master.
  * \param  [IN]  ignore_eof   Ignore EOF character (inifinite run).
+ * \param  [IN]  *rec         Recording of the session, NULL for none.
+ * \param  [IN]  *pace        Pacing of the writes to the master, NULL for
+ *                            none.
+ * \return Exit status of the program, -1 if it was not reaped.
  */
-void ptym_process_stdio( int pty_amaster, int ignore_eof );
+int ptym_process_stdio( int pty_amaster, int ignore_eof, tRecord *rec,
+                        tPace *pace );
 
 
 char *int_onoff( int onoff )
@@ -122,9 +128,9 @@ char *int_onoff( int onoff )
  * \image  html               pty_driver.png
  */
 #ifdef LINUX
-  #define OPTSTR "+bcd:ehinruv"
+  #define OPTSTR "+a:bcd:ehilnp:rs:uvw:x"
 #else
-  #define OPTSTR "bcd:ehinruv"
+  #define OPTSTR "a:bcd:ehilnp:rs:uvw:x"
 #endif
 int main( int argc, char **argv )
 {
@@ -137,6 +143,15 @@ int main( int argc, char **argv )
   int    nocontrol = 1;        // do not allow control of the PTS
   int    rederr = 0;           // redirect driver stderr to PTS
   int    c;                    // option choser
+  int    status;               // exit status of the program
+  int    attach = 0;           // session ID to attach to
+  int    list = 0;             // list sessions of the server
+  int    direct = 0;           // attach with the PTY master itself
+  char   sock[SERVER_SOCKET_LENGTH];
+  char   *record = NULL;       // file to record the session to
+  tRecord rec;
+  tPace  pace;                 // transmit pacing of -p
+  int    paced = 0;
   pid_t  pid;                  // parent/child process ID after fork()
   char   slave_name[PTS_NAME_LENGTH];
 
@@ -150,11 +165,13 @@ int main( int argc, char **argv )
   interactive = isatty( STDIN_FILENO );
   sigcaught = 0;
   child_pids = 0;
+  server_socket_path( sock );
 
   opterr = 0;           // from: unistd()
   while ( EOF != (c = getopt( argc, argv, OPTSTR)) )
   {
     switch( c ) {
+      case 'a' : attach = atoi( optarg ); break;
       case 'b' : detached = 1;      break;
       case 'c' : nocontrol = 0;     break;
       case 'd' : if ( NULL == (driver = (char*)malloc( MAX_EXEC_LENGTH )) )
@@ -165,10 +182,17 @@ int main( int argc, char **argv )
       case 'e' : noecho = 1;        break;
       case 'h' : help = 1;          break;
       case 'i' : ignoreeof = 1;     break;
+      case 'l' : list = 1;          break;
       case 'n' : interactive = 0;   break;
+      case 'p' : if ( 0 > pace_parse( &pace, optarg ) )
+                   err_quit( "Invalid pacing: %s", optarg );
+                 paced = 1;         break;
       case 'r' : rederr = 1;        break;
+      case 's' : snprintf( sock, sizeof( sock ), "%s", optarg ); break;
       case 'u' : nochr = 1;         break;
       case 'v' : verbose = 1;       break;
+      case 'w' : record = optarg;   break;
+      case 'x' : direct = 1;        break;
       case '?' : err_sys( "Unrecognized option: -%c", optopt ); break;
     }
   }
@@ -178,47 +202,44 @@ int main( int argc, char **argv )
     exit( 0 );
   }
 
-  if ( argc <= optind )
-    err_sys( "Usage: %s [-bcehinruv -d \"driver [args]\"] \"<program> [args]\"",
-             argv[0] );
+  // Sessions of the server:
+  if ( 1 == list ) {
+    if ( 0 > server_list( sock ) )
+      err_sys( "No server on %s", sock );
+    exit( 0 );
+  }
 
-  if ( (1 == verbose) && (1 == detached) )
-    err_msg( "Option '-b' is not implemented yet. Sorry.\n" );
+  if ( attach > 0 ) {
+    if ( 0 > server_attach( sock, attach, direct ) )
+      err_sys( "Cannot attach to session %i on %s", attach, sock );
+    exit( 0 );
+  }
+
+  if ( argc <= optind )
+    err_sys( "Usage: %s [-bcehilnruvx -a <id> -s <sock> -w <file> -d \"driver [args]\"] "
+             "\"<program> [args]\"", argv[0] );
+
+  // Run in a session of the server, which is started if none is running:
+  if ( 1 == detached ) {
+    if ( 0 > (c = server_new( sock, argv[optind], nochr, slave_name )) )
+      err_sys( "Cannot start session on %s", sock );
+    printf( "Session %i on %s\n", c, slave_name );
+    exit( 0 );
+  }
 
   /// \todo  Implement option-check for singleton and multi string program.
   prog_list = args_to_argl( prog, argv[optind], (size_t)MAX_EXEC_LENGTH );
 
-  // Daemonize and reestablish STDIO before duplex:
-  if ( 0 == detached ) {
-    nochr = 0;
-  } else {
-    rederr = 0;
-    cmd = (char*)malloc( 128 * sizeof( char ) );
-
-    // Track full name of the execution for syslogging:
-    if ( 0 == nochr )
-      cmd = strrchr( argv[0], '/' );
-
-    if ( NULL == cmd ) {
-      cmd = argv[0];
-    } else {
-      c = 0;
-      while ( c < argc ) {
-        cmd++;
-      }
-    }
-
-    if ( 1 == daemon_already_running( nochr ) ) {
-      syslog( LOG_ERR, "Daemon already running" );
-      exit( 1 );
-    }
-
-    daemon_daemonize( cmd, nochr, 1 );
-  }
-
   tty_save( STDIN_FILENO, &orig_termios, &orig_size );
   size = &orig_size;
 
+  // Before forking, a failure does not leave the program behind:
+  if ( (NULL != record) && (0 > rec_open( &rec, record )) ) {
+    if ( EINVAL == errno )
+      err_quit( "%s is not a recording, will not append to it", record );
+    err_sys( "Cannot open recording %s", record );
+  }
+
   // Create PTY-master/slave with appropriate terminal settings:
   if ( 1 == interactive )
     pid = pty_fork_init( &fdm, slave_name, sizeof( slave_name ), size,
@@ -289,110 +310,55 @@ int main( int argc, char **argv )
     do_driver_argl( driver, driver_list, rederr );
 
   // Duplicate STDIN to PTY-master, and PTY-master to STDOUT:
-  ptym_process_stdio( fdm, ignoreeof ); // original: loop()
+  status = ptym_process_stdio( fdm, ignoreeof,
+                               (NULL != record) ? &rec : NULL,
+                               (1 == paced) ? &pace : NULL ); // loop()
 
-  exit( 0 ); // should never reach here, due to ptym_process_stdio() is a loop.
-}
+  if ( 1 == paced )
+    pace_close( &pace );
 
+  if ( (NULL != record) && (0 > rec_close( &rec )) )
+    err_msg( "Cannot write recording %s", record );
 
-void ptym_process_stdio( int pty_amaster, int ignore_eof )
-{
-  int   nread = 0;
-  int   pac = 0; // parent abort condition (on read)
-  pid_t child;
-  char  buf[BUFLEN];
-
-  //fflush( stdin );
-  //fflush( stdout );
-
-  if ( (child = fork()) < 0 ) {
-    err_sys( "Failed forking into read/write loop" );
-  } else if ( 0 == child ) {
-
-    ///////////////////////////
-    // Inside child process: //
-    ///////////////////////////
-
-    close( STDOUT_FILENO );
-
-    while ( -1 < (nread = read( STDIN_FILENO, &buf, BUFLEN )) ) {
-      if ( 0 == nread ) {
-        if ( 0 == ignore_eof )
-          break;
-      } else {
-        if ( 0 > (write( pty_amaster, &buf, nread )) ) {
-          err_msg( "Failed writing to PTY-master FD=%i", pty_amaster );
-          break;
-        }
-      }
-
-      //ms_sleep( POLLING_TIMEOUT ); // reduce CPU load, better in VMIN/VTIME
-    }
+  if ( 0 < status )
+    exit( status ); // pass the programs exit status
 
-    /*!
-     * \note    Normally we terminate after data transmission has finished (EOF
-     *          detected).
-     *          Also, a EOF on stdio is equivalent with a HUP-signal to a
-     *          controlling terminal. Enjoying
-     *          the communicative silence by ignoring any EOF won't stop us from
-     *          doing nothing. Hence we somehow fell out of the while-ing, we
-     *          better tell the more responsible parent process about our
-     *          failure in doing nothing or something.
-     */
-    if ( 1 == ignore_eof ) {
-      // Child notifies parent, because we should not be here, but no hurry...
-      ms_sleep( 5 ); // ...maybe the parent has not finished registering the
-      // SIGTERM at the kernel so slowly fast:
-      kill( getppid(), SIGTERM );
-      /*
-       * Besides, a 'kill' from a child reaches all sisters and brothers of this
-       * process group, if the parent has granted so.
-       */
-    }
-    
-    if ( 0 < nread )
-      err_sys( "Read failure on STDIN" );
+  exit( 0 );
+}
 
-    exit( 0 ); // child cannot return
-  }
 
-  ////////////////////////////
-  // Inside parent process: //
-  ////////////////////////////
+int ptym_process_stdio( int pty_amaster, int ignore_eof, tRecord *rec,
+                        tPace *pace )
+{
+  tPty_loop lp;
+  int status;
+
+  lp.fd_in = STDIN_FILENO;
+  lp.fd_out = STDOUT_FILENO;
+  lp.fd_dev_read = pty_amaster;
+  lp.fd_dev_write = pty_amaster;
+  lp.child = child_pids;
+  lp.ignore_eof = ignore_eof;
+  lp.translate = 0;
+  lp.nolf = 0;
+  lp.linefeed = NULL;
+  lp.bufsize = BUFLEN;
+  lp.engine = PTY_LOOP_AUTO;
+  lp.escape = -1;
+  lp.rec = rec;
+  lp.pace = pace;
 
   /*!
-   * \note:  Let PTY slave side open after forking, because driver-program is
-   *         connected on parent-slave if option set:
+   * \note:  Let PTY slave side open, because driver-program is connected on
+   *         parent-slave if option set:
    *         *  close( STDIN_FILENO );
    */
 
-  if ( SIG_ERR == signal_intr( SIGTERM, sig_term ) )
-    err_sys( "Failed to install signal handler for SIGTERM" );
-
-  if ( ignore_eof > 0 )
-    pac = -1; // read aslong more than 'pac' bytes received.
-  else
-    pac = 0; // marks EOF reached
-
-  // Read/write till error, a valid EOF detected or signal interrupt:
-  while ( pac < (nread = read( pty_amaster, &buf, BUFLEN )) ) {
-    if ( nread > 0 ) {
-      if ( write( STDOUT_FILENO, &buf, nread ) != nread  ) {
-        err_msg( "Failed writing to STDOUT" );
-        break;
-      }
-    }
-    //ms_sleep( POLLING_TIMEOUT ); // reduce CPU load average
-  }
-
-  // Prevent child from growing-up as a orphan in a zombie nation:
-  if ( 0 == sigcaught )
-    kill( child, SIGTERM ); // child did not cause the interruption
-
-  if ( 0 < nread )
-    err_sys( "Read failure on PTY-master" );
+  // Read/write till error, EOF detected, signal or the program has ended:
+  if ( 0 <= (status = pty_loop( &lp )) )
+    child_pids = 0; // reaped, nothing left to terminate on exit
 
-  // Signal caught, error occured or EOF detected, parent returns to caller.
+  return ( status );
 }
 
 
@@ -401,16 +367,25 @@ void usage( char *prog_name )
   printf( "Usage: %s [OPTIONS] \"<program> [ARGS]\"\n", prog_name );
   printf( "  Run a program connected to a PTY/PTS device (pseudo-terminal.)\n" ); 
   printf( "\n  OPTIONS:\n" );
-  printf( "    -b        Run in background (detached from user session).\n" );
+  printf( "    -b        Run in background, in a new session of the server.\n" );
+  printf( "    -a <id>   Attach to session <id> of the server (CTRL-] detaches).\n" );
+  printf( "    -x        With -a: Take the PTY of the session exclusively,\n" );
+  printf( "              no copy through the server (bulk transfers).\n" );
+  printf( "    -l        List the sessions of the server.\n" );
+  printf( "    -s <sock> Socket of the server (default: " SERVER_SOCKET_FMT ").\n",
+          (unsigned)getuid() );
   printf( "    -c        Do not allow parent process control the terminal.\n" );
   printf( "    -d <drv>  Redirect programs stdin/stdout to driver program.\n" );
   printf( "    -r        Redirect driver stderr to terminal device.\n" );
+  printf( "    -w <file> Record the session with timing to <file> (appended).\n" );
+  printf( "    -p <pace> Pace the input to the program for slow readers:\n" );
+  printf( "              <bytes/s>[,<burst>[,<gap ms>]], e.g. 960,16,5.\n" );
   printf( "    -e        Disable echo on terminal output.\n" );
   printf( "    -i        Ignore EOF on read (Use: CTRL-C to stop).\n" );
   printf( "    -n        No interactive.\n" );
   printf( "    -v        Verbose mode. Print additional information on stderr.\n" );
   printf( "    -u        Unmount protected. Change to '/' root directory\n" );
-  printf( "              (takes only effect when -b is set).\n" );
+  printf( "              (takes only effect when -b starts the server).\n" );
   printf( "    -h        Print this help.\n" );
   printf( "\n  ARGS:\n" );
   printf( "    Optional arguments for <program> and <drv>. Use quoted\n" );
@@ -420,9 +395,11 @@ void usage( char *prog_name )
   printf( "\n  Notes:\n" );
   printf( "    <drv> and <program> name size is limitted to %d.\n",
           MAX_EXEC_LENGTH );
-  printf( "    When running in background ('-b' option set) daemon PID is\n" );
-  printf( "    stored in /var/run/%s, and '-r' option is ignored.\n",
-          LOCKFILE );
+  printf( "    One server runs the sessions of all '-b' calls on a socket,\n" );
+  printf( "    it ends with its last session. '-d', '-r' and '-w' are\n" );
+  printf( "    ignored.\n" );
+  printf( "    " PTY_LOOP_ENV "=epoll in the environment uses epoll instead\n" );
+  printf( "    of io_uring for the I/O.\n" );
   //printf( "    <args> is limitted to %d characters include whitespaces.\n",
   //        MAX_ARGS_LENGTH );
 }
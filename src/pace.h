@@ -0,0 +1,240 @@
+/* vi: set sw=4 ts=4: */
+
+/*!
+ * \version  1.0.0
+ * \author   ksnguyen
+ * \date     2026-10-16   Header created. Transmit pacing for slow devices,
+ *                        shared by pty, tcat and capture.
+ *
+ * \note
+ *           Header-only, for the C++ translation units and for capture.c
+ *           (plain C, built without pty.c) alike. A token bucket limits the
+ *           bytes written to a device:
+ *
+ *             rate    bytes per second on average, 0 for no limit
+ *             burst   bytes per write() at most, the size of the bucket
+ *             gap     pause between two writes at least [ms]
+ *
+ *           Instead of one write() and one sleep per character, the writer
+ *           waits once for the deadline the next burst is allowed at, then
+ *           writes the burst with one system call. Deadlines are absolute
+ *           (timerfd on CLOCK_MONOTONIC), a late wakeup is not added up.
+ *
+ *           The bucket is kept as GCRA: 'tat' is the time the bucket is full
+ *           again. A write of n bytes conforms at time t, if
+ *           tat + n*cost - burst*cost <= t.
+ *
+ *           Event loops ask pace_allow() how much may go now and else watch
+ *           the timer of pace_arm() until the deadline. Blocking writers use
+ *           pace_write().
+ *
+ *           Specification on the command line or in a config file:
+ *
+ *             <bytes/s>[,<burst>[,<gap ms>]]      e.g. 960,16,5
+ */
+
+#ifndef _PTY_PACE_H
+  #define _PTY_PACE_H
+
+#include <stdio.h>            // sscanf()
+#include <stdint.h>           // uint64_t
+#include <errno.h>
+#include <poll.h>
+#include <time.h>             // clock_gettime()
+#include <unistd.h>           // read(), write()
+#include <sys/timerfd.h>
+
+#define PACE_NS_PER_S   ( 1000000000ULL )
+#define PACE_NS_PER_MS  ( 1000000ULL )
+
+
+typedef struct {
+  uint64_t cost;        // ns per byte, 0: no rate limit
+  uint64_t gap;         // ns between two writes at least
+  size_t burst;         // bytes per write at most, 0: no limit
+  uint64_t tat;         // time the bucket is full again [ns]
+  uint64_t last;        // time of the last write [ns], 0: none yet
+  int tfd;              // timerfd, -1 until needed
+} tPace;
+
+
+static inline uint64_t pace_now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ( (uint64_t)ts.tv_sec*PACE_NS_PER_S + (uint64_t)ts.tv_nsec );
+}
+
+
+/*!
+ * \brief    Set up the pacing, all zero writes without any limit.
+ * \param    [IN]  rate         Bytes per second, 0 for no limit.
+ * \param    [IN]  burst        Bytes per write at most, 0 for no limit (one
+ *                              byte, if a rate is given).
+ * \param    [IN]  gap_ms       Pause between two writes at least.
+ */
+static inline void pace_init( tPace *p, unsigned long rate, size_t burst,
+                              unsigned long gap_ms )
+{
+  p->cost = (0 != rate) ? PACE_NS_PER_S/rate : 0;
+  p->gap = (uint64_t)gap_ms*PACE_NS_PER_MS;
+  p->burst = ((0 == burst) && (0 != rate)) ? 1 : burst;
+  p->tat = p->last = 0;
+  p->tfd = -1;
+}
+
+
+/*!
+ * \brief    Set up the pacing from "<bytes/s>[,<burst>[,<gap ms>]]".
+ * \return   0 if o.k, -1 on a malformed specification.
+ */
+static inline int pace_parse( tPace *p, const char *spec )
+{
+  unsigned long rate = 0, burst = 0, gap = 0;
+
+  if ( 1 > sscanf( spec, "%lu,%lu,%lu", &rate, &burst, &gap ) )
+    return ( -1 );
+
+  pace_init( p, rate, (size_t)burst, gap );
+
+  return ( 0 );
+}
+
+
+/*!
+ * \brief    How many of len bytes may be written now.
+ * \param    [OUT] *due         Deadline the next write may go at
+ *                              (CLOCK_MONOTONIC [ns]), if 0 is returned.
+ * \return   Bytes to write with one system call, 0 to wait until *due.
+ */
+static inline size_t pace_allow( tPace *p, size_t len, uint64_t *due )
+{
+  uint64_t now = pace_now();
+  uint64_t t = 0, need, tau;
+  size_t n = len;
+
+  if ( (0 != p->burst) && (n > p->burst) )
+    n = p->burst;
+
+  if ( (0 != p->gap) && (0 != p->last) )
+    t = p->last + p->gap;
+
+  if ( 0 != p->cost ) {
+    need = p->tat + (uint64_t)n*p->cost;
+    tau = (uint64_t)p->burst*p->cost;
+    if ( (need > tau) && (need - tau > t) )
+      t = need - tau;
+  }
+
+  if ( t > now ) {
+    *due = t;
+    return ( 0 );
+  }
+
+  return ( n );
+}
+
+
+/*!
+ * \brief    Account n bytes just written.
+ */
+static inline void pace_sent( tPace *p, size_t n )
+{
+  uint64_t now = pace_now();
+
+  if ( 0 != p->cost )
+    p->tat = ((p->tat > now) ? p->tat : now) + (uint64_t)n*p->cost;
+  p->last = now;
+}
+
+
+/*!
+ * \brief    Arm the timer to the deadline of pace_allow().
+ * \return   timerfd, readable at the deadline, or -1 on error.
+ */
+static inline int pace_arm( tPace *p, uint64_t due )
+{
+  struct itimerspec its;
+
+  if ( (0 > p->tfd) &&
+       (0 > (p->tfd = timerfd_create( CLOCK_MONOTONIC,
+                                      TFD_NONBLOCK | TFD_CLOEXEC ))) )
+    return ( -1 );
+
+  its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+  its.it_value.tv_sec = (time_t)(due/PACE_NS_PER_S);
+  its.it_value.tv_nsec = (long)(due%PACE_NS_PER_S);
+
+  if ( 0 > timerfd_settime( p->tfd, TFD_TIMER_ABSTIME, &its, NULL ) )
+    return ( -1 );
+
+  return ( p->tfd );
+}
+
+
+/*!
+ * \brief    Consume the expiry of the armed timer.
+ */
+static inline void pace_expired( tPace *p )
+{
+  uint64_t n;
+
+  while ( sizeof( n ) == read( p->tfd, &n, sizeof( n ) ) )
+    ;
+}
+
+
+/*!
+ * \brief    Write len bytes, blocking, paced. A non-blocking fd is waited
+ *           for with poll().
+ * \return   len, or -1 on error with errno set.
+ */
+static inline ssize_t pace_write( tPace *p, int fd, const void *buf,
+                                  size_t len )
+{
+  const char *b = (const char*)buf;
+  struct pollfd pfd;
+  uint64_t due;
+  size_t done = 0, n;
+  ssize_t w;
+
+  while ( done < len ) {
+    if ( 0 == (n = pace_allow( p, len - done, &due )) ) {
+      if ( 0 > (pfd.fd = pace_arm( p, due )) )
+        return ( -1 );
+      pfd.events = POLLIN;
+      if ( (0 > poll( &pfd, 1, -1 )) && (EINTR != errno) )
+        return ( -1 );
+      pace_expired( p );
+      continue;
+    }
+
+    if ( 0 > (w = write( fd, b + done, n )) ) {
+      if ( EAGAIN == errno ) {
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        poll( &pfd, 1, -1 );
+      } else if ( EINTR != errno ) {
+        return ( -1 );
+      }
+      continue;
+    }
+
+    pace_sent( p, (size_t)w );
+    done += (size_t)w;
+  }
+
+  return ( (ssize_t)done );
+}
+
+
+static inline void pace_close( tPace *p )
+{
+  if ( 0 <= p->tfd )
+    close( p->tfd );
+  p->tfd = -1;
+}
+
+#endif // _PTY_PACE_H
+// EOF
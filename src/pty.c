@@ -30,10 +30,13 @@
  */
 
 #include "pty.h"
+#include "hex.h"
 
 #include <errno.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <time.h>             // clock_gettime()
+#include <sys/stat.h>         // fstat()
 
 
 /*!
@@ -66,7 +69,7 @@ static void _err_printva( int err_flag, int err, const char *fmt, va_list ap ) {
 
   if ( err_flag )
     // First user error description then error type:
-    snprintf( buf+strlen( fmt ), MAX_ERR_MSG_SIZE-strlen( buf )-1, ": %s",
+    snprintf( buf+strlen( buf ), MAX_ERR_MSG_SIZE-strlen( buf )-1, ": %s",
               strerror( err ) );
 
   strcat( buf, "\n" );  // append linefeed
@@ -222,89 +225,322 @@ Sigfunc *signal_intr( int signo, Sigfunc *func )
 }
 
 
+/*!
+ * \brief   HEX codec kernels. Every kernel translates whole byte/character
+ *          pairs; snprintu8() and u8nprints() take care of the leading nibble
+ *          and the truncation to the output buffer size. The kernel used is
+ *          chosen once at program startup from the CPU features by
+ *          _hex_kernel_select().
+ */
 typedef struct {
-  uint8_t num;
-  char rep;
-} tLut_u8_c;
-
-
-// uint8_t nibble-char table (look-up table or dictionary, or whatever to name)
-static const tLut_u8_c u8nct[] = {
-  { 0x00, '0' }, // for HEX to char conversion, valid values start here...
-  { 0x01, '1' },
-  { 0x02, '2' },
-  { 0x03, '3' },
-  { 0x04, '4' },
-  { 0x05, '5' },
-  { 0x06, '6' },
-  { 0x07, '7' },
-  { 0x08, '8' },
-  { 0x09, '9' },
-  { 0x0A, 'a' },
-  { 0x0B, 'b' },
-  { 0x0C, 'c' },
-  { 0x0D, 'd' },
-  { 0x0E, 'e' },
-  { 0x0F, 'f' }, // ...and end here.
-  { 0x0A, 'A' }, // regard for upper- and lower-cases character translation
-  { 0x0B, 'B' },
-  { 0x0C, 'C' },
-  { 0x0D, 'D' },
-  { 0x0E, 'E' },
-  { 0x0F, 'F' }
-};
+  const char *name;
+  int  (*supported)( void );
+  void (*encode)( char *out, const uint8_t *in, size_t in_num );
+  void (*decode)( uint8_t *out, const char *in, size_t out_num );
+} tHex_kernel;
 
 
-static void _u8toc( char *high_nibble_conv, char *low_nibble_conv, uint8_t in )
+static int _hex_always( void )
 {
-  int i;
+  return ( 1 );
+}
 
-  for ( i=0; i<16; i++ ) {
-    if ( (0x0F & (in >> 4)) == u8nct[i].num ) {
-      *low_nibble_conv = u8nct[i].rep;
-      break;
-    }
+
+static void _hex_encode_scalar( char *out, const uint8_t *in, size_t in_num )
+{
+  /*!
+   * \note    Order like this:
+   *          i=0: 0x74    out[0]:  0x04
+   *                       out[1]:  0x07
+   *          i=1: 0x5A    out[2]:  0x0A
+   *                       out[3]:  0x05
+   */
+  hex::encode<hex::lower>( in, in_num, out, 2*in_num );
+}
+
+
+static void _hex_decode_scalar( uint8_t *out, const char *in, size_t out_num )
+{
+  /*!
+   * \note   The constexpr table of hex.h represents all ASCII symbols not in
+   *         range ['0'..'9', 'a'..'f', 'A'..'F'] as 0x00 to close the memory
+   *         segmentation error risk.
+   */
+  hex::decode( in, 2*out_num, out, out_num ); // input MSNibble first
+}
+
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+  #define HEX_HAVE_X86_KERNELS
+  #include <immintrin.h>
+
+static int _hex_has_sse2( void )
+{
+  return ( __builtin_cpu_supports( "sse2" ) );
+}
+
+
+static int _hex_has_avx2( void )
+{
+  return ( __builtin_cpu_supports( "avx2" ) );
+}
+
+
+/*!
+ * \brief   Map 16 characters to their nibble values. Characters not in range
+ *          ['0'..'9', 'a'..'f', 'A'..'F'] become 0x00 like with
+ *          hex::nibble_or_zero(). The signed compares reject all characters
+ *          above 0x7F.
+ */
+__attribute__(( target( "sse2" ) ))
+static __m128i _hex_nibbles_sse2( __m128i c )
+{
+  const __m128i l = _mm_or_si128( c, _mm_set1_epi8( 0x20 ) ); // lower-case
+  __m128i isdig, isalp;
+
+  isdig = _mm_and_si128( _mm_cmpgt_epi8( c, _mm_set1_epi8( '0'-1 ) ),
+                         _mm_cmplt_epi8( c, _mm_set1_epi8( '9'+1 ) ) );
+  isalp = _mm_and_si128( _mm_cmpgt_epi8( l, _mm_set1_epi8( 'a'-1 ) ),
+                         _mm_cmplt_epi8( l, _mm_set1_epi8( 'f'+1 ) ) );
+
+  return ( _mm_or_si128(
+             _mm_and_si128( isdig, _mm_sub_epi8( c, _mm_set1_epi8( '0' ) ) ),
+             _mm_and_si128( isalp, _mm_sub_epi8( l, _mm_set1_epi8( 'a'-10 ) ))
+           ) );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static void _hex_encode_sse2( char *out, const uint8_t *in, size_t in_num )
+{
+  const __m128i mask = _mm_set1_epi8( 0x0F );
+  const __m128i nine = _mm_set1_epi8( 9 );
+  const __m128i num  = _mm_set1_epi8( '0' );
+  const __m128i alph = _mm_set1_epi8( 'a' - '0' - 10 );
+  __m128i v, h, l;
+  size_t i = 0;
+
+  for ( i=0; i+16<=in_num; i+=16 ) {
+    v = _mm_loadu_si128( (const __m128i*)&in[i] );
+    h = _mm_and_si128( _mm_srli_epi16( v, 4 ), mask );
+    l = _mm_and_si128( v, mask );
+    h = _mm_add_epi8( _mm_add_epi8( h, num ),
+                      _mm_and_si128( _mm_cmpgt_epi8( h, nine ), alph ) );
+    l = _mm_add_epi8( _mm_add_epi8( l, num ),
+                      _mm_and_si128( _mm_cmpgt_epi8( l, nine ), alph ) );
+    _mm_storeu_si128( (__m128i*)&out[2*i],    _mm_unpacklo_epi8( h, l ) );
+    _mm_storeu_si128( (__m128i*)&out[2*i+16], _mm_unpackhi_epi8( h, l ) );
   }
 
-  for ( i=0; i<16; i++ ) {
-    if ( (0x0F & in) == u8nct[i].num ) {
-      *high_nibble_conv = u8nct[i].rep;
-      break;
+  _hex_encode_scalar( &out[2*i], &in[i], in_num-i ); // remainder
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static void _hex_decode_sse2( uint8_t *out, const char *in, size_t out_num )
+{
+  const __m128i lsb = _mm_set1_epi16( 0x00FF );
+  __m128i a, b;
+  size_t i = 0;
+
+  for ( i=0; i+16<=out_num; i+=16 ) {
+    a = _hex_nibbles_sse2( _mm_loadu_si128( (const __m128i*)&in[2*i] ) );
+    b = _hex_nibbles_sse2( _mm_loadu_si128( (const __m128i*)&in[2*i+16] ) );
+
+    // Even character is the high nibble, odd character the low nibble:
+    a = _mm_and_si128( _mm_or_si128( _mm_slli_epi16( a, 4 ),
+                                     _mm_srli_epi16( a, 8 ) ), lsb );
+    b = _mm_and_si128( _mm_or_si128( _mm_slli_epi16( b, 4 ),
+                                     _mm_srli_epi16( b, 8 ) ), lsb );
+    _mm_storeu_si128( (__m128i*)&out[i], _mm_packus_epi16( a, b ) );
+  }
+
+  _hex_decode_scalar( &out[i], &in[2*i], out_num-i ); // remainder
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void _hex_encode_avx2( char *out, const uint8_t *in, size_t in_num )
+{
+  const __m256i mask = _mm256_set1_epi8( 0x0F );
+  const __m256i nine = _mm256_set1_epi8( 9 );
+  const __m256i num  = _mm256_set1_epi8( '0' );
+  const __m256i alph = _mm256_set1_epi8( 'a' - '0' - 10 );
+  __m256i v, h, l, lo, hi;
+  size_t i = 0;
+
+  for ( i=0; i+32<=in_num; i+=32 ) {
+    v = _mm256_loadu_si256( (const __m256i*)&in[i] );
+    h = _mm256_and_si256( _mm256_srli_epi16( v, 4 ), mask );
+    l = _mm256_and_si256( v, mask );
+    h = _mm256_add_epi8( _mm256_add_epi8( h, num ),
+          _mm256_and_si256( _mm256_cmpgt_epi8( h, nine ), alph ) );
+    l = _mm256_add_epi8( _mm256_add_epi8( l, num ),
+          _mm256_and_si256( _mm256_cmpgt_epi8( l, nine ), alph ) );
+
+    // Unpacking works per 128 bit lane, so put the lanes back in order:
+    lo = _mm256_unpacklo_epi8( h, l );
+    hi = _mm256_unpackhi_epi8( h, l );
+    _mm256_storeu_si256( (__m256i*)&out[2*i],
+                         _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+    _mm256_storeu_si256( (__m256i*)&out[2*i+32],
+                         _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+  }
+
+  _hex_encode_sse2( &out[2*i], &in[i], in_num-i ); // remainder
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void _hex_decode_avx2( uint8_t *out, const char *in, size_t out_num )
+{
+  const __m256i lsb = _mm256_set1_epi16( 0x00FF );
+  __m256i c, l, isdig, isalp, n[2];
+  size_t i = 0;
+  int k;
+
+  for ( i=0; i+32<=out_num; i+=32 ) {
+    for ( k=0; k<2; k++ ) {
+      c = _mm256_loadu_si256( (const __m256i*)&in[2*i + 32*k] );
+      l = _mm256_or_si256( c, _mm256_set1_epi8( 0x20 ) );
+
+      isdig = _mm256_and_si256(
+                _mm256_cmpgt_epi8( c, _mm256_set1_epi8( '0'-1 ) ),
+                _mm256_cmpgt_epi8( _mm256_set1_epi8( '9'+1 ), c ) );
+      isalp = _mm256_and_si256(
+                _mm256_cmpgt_epi8( l, _mm256_set1_epi8( 'a'-1 ) ),
+                _mm256_cmpgt_epi8( _mm256_set1_epi8( 'f'+1 ), l ) );
+
+      c = _mm256_or_si256(
+            _mm256_and_si256( isdig,
+                              _mm256_sub_epi8( c, _mm256_set1_epi8( '0' ) ) ),
+            _mm256_and_si256( isalp,
+                              _mm256_sub_epi8( l, _mm256_set1_epi8( 'a'-10 ) ) ) );
+
+      n[k] = _mm256_and_si256( _mm256_or_si256( _mm256_slli_epi16( c, 4 ),
+                                                _mm256_srli_epi16( c, 8 ) ),
+                               lsb );
     }
+
+    // Packing works per 128 bit lane, so put the quad-words back in order:
+    _mm256_storeu_si256( (__m256i*)&out[i],
+                         _mm256_permute4x64_epi64(
+                           _mm256_packus_epi16( n[0], n[1] ), 0xD8 ) );
   }
+
+  _hex_decode_sse2( &out[i], &in[2*i], out_num-i ); // remainder
 }
+#endif // HEX_HAVE_X86_KERNELS
 
 
-static uint8_t _ctou8( char in_char )
+// Ordered by preference, the portable scalar kernel always comes last:
+static const tHex_kernel hex_kernels[] = {
+#if defined( HEX_HAVE_X86_KERNELS )
+  { "avx2",   _hex_has_avx2, _hex_encode_avx2,   _hex_decode_avx2   },
+  { "sse2",   _hex_has_sse2, _hex_encode_sse2,   _hex_decode_sse2   },
+#endif
+  { "scalar", _hex_always,   _hex_encode_scalar, _hex_decode_scalar }
+};
+
+#define HEX_KERNELS ( sizeof( hex_kernels ) / sizeof( hex_kernels[0] ) )
+
+static const tHex_kernel *hex_kernel = &hex_kernels[HEX_KERNELS-1];
+
+
+__attribute__(( constructor ))
+static void _hex_kernel_select( void )
 {
-  int i;
-  uint8_t out;
+  size_t k;
 
-  /*!
-   * \note   Using conversion LUT to represent all ASCII symbols not in range
-   *         ['0'..'9', 'a'..'f', 'A'..'F'] as 0x00 to close the memory
-   *         segmentation error risk.
-   */ 
-  for ( i=0; i<21 ; i++ ) {
-    if ( in_char == u8nct[i].rep ) {
-      out = u8nct[i].num;
+#if defined( HEX_HAVE_X86_KERNELS )
+  __builtin_cpu_init(); // we may run before the libgcc constructors
+#endif
+
+  for ( k=0; k<HEX_KERNELS; k++ ) {
+    if ( hex_kernels[k].supported() ) {
+      hex_kernel = &hex_kernels[k];
       break;
     }
+  }
+}
+
+
+const char *hex_kernel_name( void )
+{
+  return ( hex_kernel->name );
+}
+
+
+static double _elapsed_s( const struct timespec *t0 )
+{
+  struct timespec t1;
+
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+
+  return ( (double)(t1.tv_sec - t0->tv_sec) +
+           (double)(t1.tv_nsec - t0->tv_nsec) / 1e9 );
+}
+
+
+#define HEX_REPORT_MIN_TIME ( 0.2 ) // [s] per kernel and direction
+int hex_kernel_report( FILE *stream, size_t len )
+{
+  size_t k, i, rounds;
+  double te, td;
+  struct timespec t0;
+  uint8_t *raw = NULL;
+  char *txt = NULL;
+
+  if ( 0 == len )
+    len = 1;
+
+  if ( (NULL == (raw = (uint8_t*)malloc( len ))) ||
+       (NULL == (txt = (char*)malloc( 2*len ))) ) {
+    free( raw );
+    err_msg( "Not enough space for HEX kernel report buffers" );
+    return ( -1 );
+  }
+
+  for ( i=0; i<len; i++ )
+    raw[i] = (uint8_t)(i * 0x9E + (i >> 8)); // some non-repeating pattern
+
+  fprintf( stream, "HEX kernel in use: %s\n", hex_kernel_name() );
+
+  for ( k=0; k<HEX_KERNELS; k++ ) {
+    if ( ! hex_kernels[k].supported() )
+      continue;
 
-    out = 0x00;
+    rounds = 0;
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    do {
+      hex_kernels[k].encode( txt, raw, len );
+      rounds++;
+    } while ( (te = _elapsed_s( &t0 )) < HEX_REPORT_MIN_TIME );
+    te = (double)(rounds * len) / te;
+
+    rounds = 0;
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    do {
+      hex_kernels[k].decode( raw, txt, len );
+      rounds++;
+    } while ( (td = _elapsed_s( &t0 )) < HEX_REPORT_MIN_TIME );
+    td = (double)(rounds * 2*len) / td;
+
+    fprintf( stream, "  %-8s u8nprints: %14.0f bytes/s  snprintu8: %14.0f "
+             "bytes/s\n", hex_kernels[k].name, te, td );
   }
 
-  return ( out );
+  free( raw );
+  free( txt );
+
+  return ( 0 );
 }
 
 
 size_t snprintu8( uint8_t *out, size_t out_size, char *in, size_t in_size )
 {
   size_t os = 0;    // out-size
-  size_t i = 0;     // out-index of concatenated byte
-  size_t index = 0; // in-index
   const size_t shift = (in_size % 2); // decide if leading 0 is to append
-  uint8_t h, l;     // high and low nibble
 
   // Prevent memory excess violation
   if ( out_size < (in_size/2 + shift) ) {
@@ -326,40 +562,212 @@ size_t snprintu8( uint8_t *out, size_t out_size, char *in, size_t in_size )
 
   // input MSB first:
   if ( 1 == shift )
-    out[0] = (0x0F & _ctou8( in[0] ));
+    out[0] = hex::nibble_or_zero( in[0] );
 
-  for ( i=shift; i<os; i++ ) {
-    index = (i*2) + 1 - shift;
-    l = _ctou8( in[index]   );
-    h = _ctou8( in[index-1] ); // input MSNibble first
-    out[i] = (0xF0 & (h<<4)) | (0x0F & l);
-  }
+  if ( os > shift )
+    hex_kernel->decode( &out[shift], &in[shift], os-shift );
 
-  return ( i ); 
+  return ( os ); 
 }
 
 
 size_t u8nprints( char *out, size_t out_size, uint8_t *in, size_t in_num )
 {
-  size_t i = 0;
   size_t brs = in_num; // bytes reserved for storing translated characters
 
   // Truncate, if too big for result buffer:
   if ( out_size < (in_num*2) )
     brs = out_size/2;
 
-  for( i=0; i<brs; i++ ) {
+  hex_kernel->encode( out, in, brs );
+
+  return( brs*2 );
+}
+
+
+void hex_decoder_init( tHex_decoder *dec, int skip_sep, int lead_nibble )
+{
+  dec->pending = (1 == lead_nibble) ? 0 : -1;
+  dec->pending_zero = 0;
+  dec->skip_sep = skip_sep;
+}
+
+
+static int _hex_is_sep( char c )
+{
+  return ( (' ' == c) || ('\n' == c) || ('\r' == c) || ('\t' == c) ||
+           ('\v' == c) || ('\f' == c) );
+}
+
+
+size_t hex_decode_stream( tHex_decoder *dec, uint8_t *out, const char *in,
+                          size_t in_size )
+{
+  size_t i = 0, o = 0;
+  size_t run;
+  char c;
+
+  /*!
+   * \note    Output never overtakes input (byte o is written after character
+   *          2*o-1 has been read), so *out may be *in. The kernels load their
+   *          input block before storing the result, which holds for them too.
+   */
+  while ( i < in_size ) {
+    // Whole pairs go through the HEX kernel:
+    if ( dec->pending < 0 ) {
+      if ( 1 == dec->skip_sep ) {
+        for ( run=i; run<in_size; run++ )
+          if ( hex::invalid == hex::nibble( in[run] ) )
+            break;
+        run -= i;
+      } else {
+        run = in_size - i;
+      }
+
+      if ( (run /= 2) > 0 ) {
+        hex_kernel->decode( &out[o], &in[i], run );
+        o += run;
+        i += 2*run;
+        continue;
+      }
+    }
+
+    c = in[i++];
+
+    if ( 1 == dec->skip_sep ) {
+      if ( _hex_is_sep( c ) )
+        continue;
+
+      if ( ('x' == c) || ('X' == c) ) {
+        if ( 1 == dec->pending_zero )
+          dec->pending = -1; // the '0' of "0x" was no nibble
+        dec->pending_zero = 0;
+        continue;
+      }
+    }
+
+    if ( dec->pending < 0 ) {
+      dec->pending = hex::nibble_or_zero( c );
+      dec->pending_zero = ('0' == c) ? 1 : 0;
+    } else {
+      out[o++] = (uint8_t)((dec->pending << 4) | hex::nibble_or_zero( c ));
+      dec->pending = -1;
+      dec->pending_zero = 0;
+    }
+  }
+
+  return ( o );
+}
+
+
+size_t hex_decode_flush( tHex_decoder *dec, uint8_t *out )
+{
+  if ( dec->pending < 0 )
+    return ( 0 );
+
+  out[0] = (uint8_t)dec->pending;
+  dec->pending = -1;
+  dec->pending_zero = 0;
+
+  return ( 1 );
+}
+
+
+#define HEXDUMP_OFFSET_SIZE ( 18 ) // 16 digits, ':' and ' '
+
+static size_t _hexdump_groups( const tHexdump_fmt *fmt )
+{
+  return ( (fmt->cols + fmt->group - 1) / fmt->group );
+}
+
+
+size_t hexdump_line_size( const tHexdump_fmt *fmt )
+{
+  size_t size = 2*fmt->cols + _hexdump_groups( fmt ); // separators, linefeed
+
+  if ( 1 == fmt->offset )
+    size += HEXDUMP_OFFSET_SIZE;
+  if ( 1 == fmt->ascii )
+    size += 2 + fmt->cols;
+
+  return ( size );
+}
+
+
+size_t hexdump_line( char *out, const uint8_t *in, size_t n, uint64_t offset,
+                     const tHexdump_fmt *fmt )
+{
+  const hex::digit_table &t = hex::digits<hex::lower>::table;
+  const size_t g = fmt->group;
+  const size_t groups = _hexdump_groups( fmt );
+  uint8_t word[HEXDUMP_MAX_COLS];
+  char digits[2*HEXDUMP_MAX_COLS];
+  uint8_t ob[8];
+  size_t i, j, k, w, gl, src;
+  char *o = out;
+
+  if ( n > fmt->cols )
+    n = fmt->cols;
+
+  if ( 1 == fmt->offset ) {
+    w = (offset >> 32) ? 8 : 4; // widen beyond 4 GiB only
+    for ( i=0; i<w; i++ )
+      ob[i] = (uint8_t)(offset >> (8*(w-1-i)));
+    hex_kernel->encode( o, ob, w );
+    o += 2*w;
+    *o++ = ':';
+    *o++ = ' ';
+  }
+
+  if ( (n == fmt->cols) && (0 == n % g) ) {
     /*!
-     * \note    Order like this:
-     *          i=0: 0x74    out[0]:  0x04
-     *                       out[1]:  0x07
-     *          i=1: 0x5A    out[2]:  0x0A
-     *                       out[3]:  0x05
+     * \brief   Full line: Put the bytes in display order, encode all of them
+     *          with the SIMD kernel, then cut the digits into groups.
      */
-    _u8toc( &out[2*i+1], &out[2*i], in[i] );
+    if ( (1 == fmt->swap) && (g > 1) ) {
+      for ( k=0; k<n; k+=g )
+        for ( j=0; j<g; j++ )
+          word[k+j] = in[k+g-1-j];
+      hex_kernel->encode( digits, word, n );
+    } else {
+      hex_kernel->encode( digits, in, n );
+    }
+
+    for ( k=0; k<groups; k++ ) {
+      if ( k > 0 )
+        *o++ = ' ';
+      memcpy( o, &digits[2*k*g], 2*g );
+      o += 2*g;
+    }
+  } else {
+    // Last line: missing bytes are blanks, so the columns stay aligned.
+    for ( k=0; k<groups; k++ ) {
+      if ( k > 0 )
+        *o++ = ' ';
+      gl = (fmt->cols - k*g < g) ? fmt->cols - k*g : g; // last group shorter
+      for ( j=0; j<gl; j++ ) {
+        src = k*g + ((1 == fmt->swap) ? gl-1-j : j);
+        if ( src < n ) {
+          *o++ = t.v[in[src]][0];
+          *o++ = t.v[in[src]][1];
+        } else {
+          *o++ = ' ';
+          *o++ = ' ';
+        }
+      }
+    }
+  }
+
+  if ( 1 == fmt->ascii ) {
+    *o++ = ' ';
+    *o++ = ' ';
+    for ( i=0; i<n; i++ )
+      *o++ = ((in[i] >= 0x20) && (in[i] < 0x7F)) ? (char)in[i] : '.';
   }
 
-  return( i*2 ); 
+  *o++ = '\n';
+
+  return ( (size_t)(o - out) );
 }
 
 
@@ -383,7 +791,7 @@ int open_for_read_or_warn_stdin( const char *filename, int verbose )
 {
   int fd = STDIN_FILENO;
 
-  if ( *filename != *standard_input ) {
+  if ( 0 != strcmp( filename, standard_input ) ) {
     if ( 0 > (fd = open( filename, O_RDONLY )) ) // (O_RDONLY | O_NONBLOCK);
       err_msg( "Cannot open %s for read", (char*)filename );
 
@@ -399,7 +807,7 @@ int open_for_write_or_warn_stdout( const char *filename, int verbose )
 {
   int fd = STDOUT_FILENO;
 
-  if ( *filename != *standard_output ) {
+  if ( 0 != strcmp( filename, standard_output ) ) {
     if ( 0 > (fd = open( filename, O_WRONLY )) )
       err_msg( "Cannot open %s for write", (char*)filename );
 
@@ -422,21 +830,66 @@ ssize_t write_or_warn( int fd, const void *buf, size_t len )
 }
 
 
+/*!
+ * \brief   Wait with poll() until fd is ready for events or the deadline has
+ *          passed. Signals do not end the wait early.
+ * \return  1 if ready, 0 at the deadline (errno ETIMEDOUT), -1 on error.
+ */
+static int _fd_wait( int fd, short events, uint64_t deadline_ns )
+{
+  struct pollfd pfd;
+  struct timespec ts;
+  uint64_t now;
+  int n;
+
+  pfd.fd = fd;
+  pfd.events = events;
+
+  for ( ;; ) {
+    if ( 0 != deadline_ns ) {
+      if ( (now = pace_now()) >= deadline_ns ) {
+        errno = ETIMEDOUT;
+        return ( 0 );
+      }
+      ts.tv_sec = (time_t)((deadline_ns - now)/1000000000ULL);
+      ts.tv_nsec = (long)((deadline_ns - now)%1000000000ULL);
+    }
+
+    if ( 0 < (n = ppoll( &pfd, 1, (0 != deadline_ns) ? &ts : NULL, NULL )) )
+      return ( 1 ); // POLLHUP/POLLERR as well, the next call tells
+    if ( (0 > n) && (EINTR != errno) )
+      return ( -1 );
+  }
+}
+
+
 ssize_t full_write( int fd, const void *buf, size_t len )
+{
+  return ( full_write_deadline( fd, buf, len, 0 ) );
+}
+
+
+ssize_t full_write_deadline( int fd, const void *buf, size_t len,
+                             uint64_t deadline_ns )
 {
   ssize_t cc = 0;
   ssize_t total = 0;
   size_t remaining = len;
 
-  while ( (remaining > 0) ) { //|| (errno != EINTR) ) {
+  while ( remaining > 0 ) {
     cc = write( fd, buf, remaining );
 
     if ( cc < 0 ) {
-      if ( total > 0 ) { // EOF detected
-        return total;
-      }
+      // O_NONBLOCK set by someone else: wait for room instead of giving up
+      if ( EAGAIN == errno )
+        cc = _fd_wait( fd, POLLOUT, deadline_ns );
+      if ( (EINTR == errno) || (0 < cc) )
+        continue;
+
+      if ( total > 0 )
+        return total; // the part written, errno tells why not all
 
-      return cc; // write() returns -1 on failure.
+      return ( (0 == cc) ? 0 : -1 ); // 0: deadline, nothing written
     }
 
     total += cc;
@@ -448,310 +901,2368 @@ ssize_t full_write( int fd, const void *buf, size_t len )
 }
 
 
-#define NO_TIMEH_TIMEOUT_LIMIT   ( 2 )
-ssize_t nonblock_immune_read( int fd, void *buf, size_t count )
+/*!
+ * \brief   Drop the buffers written completely, cut the one written partially.
+ *          Empty buffers are dropped as well, writev() would return 0 for them.
+ */
+static void _iov_consume( struct iovec **iov, int *iovcnt, size_t done )
 {
-  unsigned long nt_timeout = (NO_TIMEH_TIMEOUT_LIMIT * 1000000); 
-  ssize_t n = -1;
+  while ( (*iovcnt > 0) && (done >= (*iov)->iov_len) ) {
+    done -= (*iov)->iov_len;
+    (*iov)++;
+    (*iovcnt)--;
+  }
 
-  do {
-    n = read( fd, buf, count); // ignore read
-    if ( (n >= 0) || (EAGAIN != errno) )
-      return n;
+  if ( *iovcnt > 0 ) {
+    (*iov)->iov_base = (char*)(*iov)->iov_base + done;
+    (*iov)->iov_len -= done;
+  }
+}
 
-    // If fd is in O_NONBLOCK mode. Wait and repeat:
-    nt_timeout--;
 
-  } while ( (n < 0) && (errno == EINTR) && (nt_timeout > 0) );
+ssize_t full_writev( int fd, struct iovec *iov, int iovcnt )
+{
+  ssize_t cc = 0;
+  ssize_t total = 0;
 
-  return n;
-}
+  _iov_consume( &iov, &iovcnt, 0 );
 
+  while ( iovcnt > 0 ) {
+    if ( 0 > (cc = writev( fd, iov, iovcnt )) ) {
+      if ( (EAGAIN == errno) && (0 < _fd_wait( fd, POLLOUT, 0 )) )
+        continue;
+      if ( EINTR == errno )
+        continue;
 
-/*!
- * \note   To prevent memory leaks, the dynamic allocated buffers of theese
- *         functions are initialized in this section:
- *         *   hcat()
- *         *   loop_driver_stdio()
- *         *   args_to_argv()
- *         The calling program should install the automatic memory freeing
- *         function pty_buffers_atexit() before usage.
- */
-void *hcat_tbuf   = NULL; // hcat()              pointer to translation buffer
-void *hcat_bigbuf = NULL; // hcat()              pointer to concatenation buffer
-void *lds_tbuf    = NULL; // loop_duplex_stdio() pointer to translation buffer
-void *lds_buffer  = NULL; // loop_duplex_stdio() pointer to read/write buffer
-char **a2av_strv  = NULL; // args_to_argv()      pointer to result string-array
+      return ( (total > 0) ? total : cc );
+    }
 
+    total += cc;
+    _iov_consume( &iov, &iovcnt, (size_t)cc );
+  }
 
-static void _bfrees( void ) {
-  free( hcat_tbuf );
-  free( hcat_bigbuf );
-  free( lds_tbuf );
-  free( lds_buffer );
-  free( a2av_strv );
+  return ( total );
+}
 
-  /*!
-   * \note  free() does nothing, if address is NULL.
-   */
 
-  // Fuse further usage:
-  //hcat_tbuf = NULL;
-  // [...] = NULL;
+ssize_t nonblock_immune_read( int fd, void *buf, size_t count )
+{
+  return ( nonblock_immune_read_deadline( fd, buf, count, 0 ) );
 }
 
 
-static void _bflush( void *addr, size_t flushsize, const char *initval )
+ssize_t nonblock_immune_read_deadline( int fd, void *buf, size_t count,
+                                       uint64_t deadline_ns )
 {
-  int c = (int)*initval;
+  ssize_t n;
 
-  // Using <string.h>:
-  if ( NULL == memset( addr, c, flushsize ) )
-    err_sys( "Buffer flush failure" );
+  for ( ;; ) {
+    if ( 0 <= (n = read( fd, buf, count )) )
+      return n;
+
+    // If fd is in O_NONBLOCK mode, wait for data without spinning:
+    if ( EAGAIN == errno ) {
+      if ( 0 >= _fd_wait( fd, POLLIN, deadline_ns ) )
+        return -1; // errno ETIMEDOUT at the deadline
+    } else if ( EINTR != errno ) {
+      return n;
+    }
+  }
 }
 
 
-void pty_buffers_atexit( void )
+uint64_t pty_deadline( unsigned int timeout_ms )
 {
-  if ( 0 != atexit( _bfrees ) )
-    err_sys( "Cannot install the exit-handler" );
+  return ( pace_now() + (uint64_t)timeout_ms*1000000ULL );
 }
 
 
-#define BIG_BUFFER_SIZE ( 1024*sizeof( char ) )
-int hcat( int fd_concat, char **argv, int a2h, int h2a, int verbose )
+/*!
+ * \brief   Read into buf until want bytes are there, a read brought one of
+ *          the delimiters (delim != NULL) or the deadline has passed. Waits
+ *          with ppoll() for the time left, then reads all there is up to cap.
+ */
+static ssize_t _read_deadline( int fd, char *buf, size_t cap, size_t want,
+                               const char *delim, uint64_t deadline_ns )
 {
-  int fd = STDIN_FILENO;
-  int retval = EXIT_SUCCESS;
-  size_t nwrite = 0;
-  ssize_t nread = 0;
-  ssize_t nwritten = 0;
+  uint8_t stop[32];                 // delimiters, one bit per byte value
+  size_t have = 0;
+  ssize_t i, n;
+
+  memset( stop, 0, sizeof( stop ) );
+  for ( ; (NULL != delim) && ('\0' != *delim); delim++ )
+    stop[(uint8_t)*delim >> 3] |= (uint8_t)(1 << ((uint8_t)*delim & 7));
+
+  while ( have < want ) {
+    if ( 0 == (n = _fd_wait( fd, POLLIN, deadline_ns )) )
+      return ( (ssize_t)have ); // errno ETIMEDOUT
+    if ( 0 > n )
+      return ( (have > 0) ? (ssize_t)have : -1 );
+
+    if ( 0 > (n = read( fd, buf + have, cap - have )) ) {
+      if ( (EAGAIN == errno) || (EINTR == errno) )
+        continue;
+      return ( (have > 0) ? (ssize_t)have : -1 );
+    }
 
-  hcat_tbuf = NULL;
-  hcat_bigbuf = malloc( BIG_BUFFER_SIZE );
+    if ( 0 == n ) { // EOF
+      errno = 0;
+      return ( (ssize_t)have );
+    }
 
+    for ( i=0; (NULL != delim) && (i < n); i++ ) {
+      if ( stop[(uint8_t)buf[have + i] >> 3] & (1 << ((uint8_t)buf[have + i] & 7)) ) {
+        errno = 0;
+        return ( (ssize_t)(have + n) );
+      }
+    }
+
+    have += (size_t)n;
+  }
+
+  // All wanted, or buf full before a delimiter came:
+  errno = (NULL != delim) ? ENOBUFS : 0;
+  return ( (ssize_t)have );
+}
+
+
+ssize_t pty_read_exact( int fd, void *buf, size_t n, uint64_t deadline_ns )
+{
+  return ( _read_deadline( fd, (char*)buf, n, n, NULL, deadline_ns ) );
+}
+
+
+ssize_t pty_read_until( int fd, void *buf, size_t cap, const char *delim_set,
+                        uint64_t deadline_ns )
+{
+  return ( _read_deadline( fd, (char*)buf, cap, cap, delim_set, deadline_ns ) );
+}
+
+
+#define IOBUF_MIN_SIZE      ( 128 )
+#define IOBUF_GROW_AFTER    ( 2 )           // full reads in a row to double
+#define IOBUF_SHRINK_AFTER  ( 8 )           // sparse reads in a row to halve
+#define IOBUF_IDLE_NS       ( 1000000000L ) // silence to fall back to start size
+
+int iobuf_init( tIobuf *ib, int fd, size_t cap, int alloc )
+{
+  struct stat st;
+  size_t size = 0;
+
+  if ( 0 == fstat( fd, &st ) ) {
+  #if defined( F_GETPIPE_SZ )
+    if ( S_ISFIFO( st.st_mode ) ) {
+      int psz = fcntl( fd, F_GETPIPE_SZ );
+      if ( psz > 0 )
+        size = (size_t)psz;
+    }
+  #endif
+    if ( (0 == size) && (st.st_blksize > 0) )
+      size = (size_t)st.st_blksize;
+  }
+
+  if ( cap < IOBUF_MIN_SIZE )
+    cap = IOBUF_MIN_SIZE;
+  if ( size < IOBUF_MIN_SIZE )
+    size = IOBUF_MIN_SIZE;
+  if ( size > cap )
+    size = cap;
+
+  ib->size = ib->min = size;
+  ib->cap = cap;
+  ib->own = alloc;
+  ib->full = ib->sparse = 0;
+  ib->buf = NULL;
+  clock_gettime( CLOCK_MONOTONIC, &ib->last );
+
+  if ( 1 == alloc ) {
+    if ( NULL == (ib->buf = (char*)malloc( size )) )
+      return ( -1 );
+  }
+
+  return ( 0 );
+}
+
+
+void iobuf_adapt( tIobuf *ib, ssize_t nread )
+{
+  struct timespec now;
+  long idle;
+  size_t want;
+  char *p;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  idle = (now.tv_sec - ib->last.tv_sec) * 1000000000L +
+         (now.tv_nsec - ib->last.tv_nsec);
+  ib->last = now;
+
+  if ( nread <= 0 )
+    return;
+
+  want = ib->size;
+
+  if ( idle >= IOBUF_IDLE_NS ) {
+    // Session woke up, likely interactive again:
+    want = ib->min;
+    ib->full = ib->sparse = 0;
+  } else if ( (size_t)nread == ib->size ) {
+    ib->sparse = 0;
+    if ( ++ib->full >= IOBUF_GROW_AFTER ) {
+      want = (2*ib->size < ib->cap) ? 2*ib->size : ib->cap;
+      ib->full = 0;
+    }
+  } else if ( (size_t)nread < ib->size/4 ) {
+    ib->full = 0;
+    if ( ++ib->sparse >= IOBUF_SHRINK_AFTER ) {
+      want = (ib->size/2 > ib->min) ? ib->size/2 : ib->min;
+      ib->sparse = 0;
+    }
+  } else {
+    ib->full = ib->sparse = 0;
+  }
+
+  if ( want == ib->size )
+    return;
+
+  if ( 1 == ib->own ) {
+    // Content is not needed anymore, a failing resize keeps the old buffer:
+    if ( NULL == (p = (char*)realloc( ib->buf, want )) )
+      return;
+    ib->buf = p;
+  }
+
+  ib->size = want;
+}
+
+
+void iobuf_free( tIobuf *ib )
+{
+  if ( 1 == ib->own )
+    free( ib->buf );
+
+  ib->buf = NULL;
+}
+
+
+static uint64_t _rec_now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec );
+}
+
+
+static void _rec_put_le( char *p, uint64_t v, int nbytes )
+{
+  int i;
+
+  for ( i=0; i<nbytes; i++, v >>= 8 )
+    p[i] = (char)(v & 0xFF);
+}
+
+
+int rec_open( tRecord *rec, const char *path )
+{
+  char magic[REC_MAGIC_LEN];
+  struct stat sb;
+  int err;
+
+  memset( rec, 0, sizeof( *rec ) );
+
+  if ( 0 > (rec->fd = open( path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                            S_IRUSR | S_IWUSR )) )
+    return ( -1 );
+
+  if ( NULL == (rec->buf = (char*)malloc( REC_BUFSIZE )) )
+    goto rec_open_errout;
+
+  if ( 0 > fstat( rec->fd, &sb ) )
+    goto rec_open_errout;
+
+  if ( 0 == sb.st_size ) {
+    memcpy( rec->buf, REC_MAGIC, REC_MAGIC_LEN );
+    rec->len = REC_MAGIC_LEN;
+  } else if ( (REC_MAGIC_LEN != pread( rec->fd, magic, REC_MAGIC_LEN, 0 )) ||
+              (0 != memcmp( magic, REC_MAGIC, REC_MAGIC_LEN )) ) {
+    errno = EINVAL; // e.g. plain text of script(1), replay would refuse it
+    goto rec_open_errout;
+  }
+
+  rec->last = _rec_now();
+
+  return ( 0 );
+
+rec_open_errout:
+  err = errno;
+  close( rec->fd );
+  free( rec->buf );
+  rec->fd = -1;
+  rec->buf = NULL;
+  errno = err;
+  return ( -1 );
+}
+
+
+int rec_flush( tRecord *rec )
+{
+  ssize_t n;
+
+  if ( 0 == rec->len )
+    return ( 0 );
+
+  n = full_write( rec->fd, rec->buf, rec->len );
+  rec->len = 0;
+
+  return ( (0 > n) ? -1 : 0 );
+}
+
+
+int rec_writev( tRecord *rec, int dir, const struct iovec *iov, int iovcnt )
+{
+  struct iovec v[REC_IOV_MAX+1];
+  char hdr[REC_HDR_LEN];
+  uint64_t now;
+  size_t len = 0;
+  int i;
+
+  for ( i=0; i<iovcnt; i++ )
+    len += iov[i].iov_len;
+
+  if ( 0 == len )
+    return ( 0 );
+
+  now = _rec_now();
+  _rec_put_le( hdr, now - rec->last, 8 );
+  hdr[8] = (char)dir;
+  _rec_put_le( hdr+9, (uint64_t)len, 4 );
+  rec->last = now;
+
+  if ( (rec->len + REC_HDR_LEN + len > REC_BUFSIZE) && (0 > rec_flush( rec )) )
+    return ( -1 );
+
+  if ( REC_HDR_LEN + len <= REC_BUFSIZE ) {
+    memcpy( rec->buf + rec->len, hdr, REC_HDR_LEN );
+    rec->len += REC_HDR_LEN;
+    for ( i=0; i<iovcnt; i++ ) {
+      memcpy( rec->buf + rec->len, iov[i].iov_base, iov[i].iov_len );
+      rec->len += iov[i].iov_len;
+    }
+    return ( 0 );
+  }
+
+  // Larger than the buffer: Write it through, header and payload at once:
+  v[0].iov_base = hdr;
+  v[0].iov_len = REC_HDR_LEN;
+  for ( i=0; (i < iovcnt) && (i < REC_IOV_MAX); i++ )
+    v[i+1] = iov[i];
+
+  return ( ((ssize_t)(REC_HDR_LEN + len) == full_writev( rec->fd, v, i+1 )) ?
+           0 : -1 );
+}
+
+
+int rec_close( tRecord *rec )
+{
+  int retval;
+
+  if ( rec->fd < 0 )
+    return ( 0 );
+
+  retval = rec_flush( rec );
+  if ( 0 > close( rec->fd ) )
+    retval = -1;
+
+  free( rec->buf );
+  rec->buf = NULL;
+  rec->fd = -1;
+
+  return ( retval );
+}
+
+
+static uint64_t _rec_get_le( const unsigned char *p, int nbytes )
+{
+  uint64_t v = 0;
+
+  while ( nbytes-- > 0 )
+    v = (v << 8) | p[nbytes];
+
+  return ( v );
+}
+
+
+int rec_check( FILE *fp )
+{
+  char magic[REC_MAGIC_LEN];
+
+  if ( (1 != fread( magic, REC_MAGIC_LEN, 1, fp )) ||
+       (0 != memcmp( magic, REC_MAGIC, REC_MAGIC_LEN )) )
+    return ( -1 );
+
+  return ( 0 );
+}
+
+
+ssize_t rec_read( FILE *fp, uint64_t *delta, int *dir, char **buf,
+                  size_t *size )
+{
+  unsigned char hdr[REC_HDR_LEN];
+  size_t len;
+  void *p;
+
+  if ( REC_HDR_LEN != (len = fread( hdr, 1, REC_HDR_LEN, fp )) ) {
+    if ( ferror( fp ) )
+      return ( -1 );
+    if ( 0 == len )
+      return ( 0 ); // end of the recording
+
+    errno = EIO; // header cut short, e.g. by a crash while flushing
+    return ( -1 );
+  }
+
+  *delta = _rec_get_le( hdr, 8 );
+  *dir = (int)hdr[8];
+  len = (size_t)_rec_get_le( hdr+9, 4 );
+
+  if ( len > *size ) {
+    if ( NULL == (p = realloc( *buf, len )) )
+      return ( -1 );
+    *buf = (char*)p;
+    *size = len;
+  }
+
+  if ( (len > 0) && (1 != fread( *buf, len, 1, fp )) ) {
+    errno = EIO;
+    return ( -1 );
+  }
+
+  return ( (ssize_t)len );
+}
+
+
+/*!
+ * \note   To prevent memory leaks, the dynamic allocated buffers of theese
+ *         functions are initialized in this section:
+ *         *   hcat()
+ *         *   args_to_argv()
+ *         The calling program should install the automatic memory freeing
+ *         function pty_buffers_atexit() before usage.
+ */
+void *hcat_tbuf   = NULL; // hcat()              pointer to translation buffer
+void *hcat_bigbuf = NULL; // hcat()              pointer to concatenation buffer
+char **a2av_strv  = NULL; // args_to_argv()      pointer to result string-array
+
+
+static void _bfrees( void ) {
+  free( hcat_tbuf );
+  free( hcat_bigbuf );
+  free( a2av_strv );
+
+  /*!
+   * \note  free() does nothing, if address is NULL.
+   */
+
+  // Fuse further usage:
+  //hcat_tbuf = NULL;
+  // [...] = NULL;
+}
+
+
+static void _bflush( void *addr, size_t flushsize, const char *initval )
+{
+  int c = (int)*initval;
+
+  // Using <string.h>:
+  if ( NULL == memset( addr, c, flushsize ) )
+    err_sys( "Buffer flush failure" );
+}
+
+
+void pty_buffers_atexit( void )
+{
+  if ( 0 != atexit( _bfrees ) )
+    err_sys( "Cannot install the exit-handler" );
+}
+
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>      // SYS_pidfd_open
+#include <poll.h>
+
+#if defined( __linux__ ) && !defined( PTY_NO_IO_URING ) && defined( __has_include )
+  #if __has_include( <linux/io_uring.h> )
+    #include <linux/io_uring.h>
+    #define PTY_HAVE_IO_URING
+  #endif
+#endif
+
+#if defined( __linux__ )
+  #include <sys/sendfile.h>
+
+#define ZERO_COPY_CHUNK  ( (size_t)1 << 30 )  // per copy_file_range()/sendfile()
+#define SPLICE_PIPE_SIZE ( 1024*1024 )        // intermediate pipe capacity
+
+
+/*!
+ * \brief   Errors on which the kernel-side copy is not available for the given
+ *          pair of files, but the buffered read()/write() loop still works.
+ */
+static int _zero_copy_unsupported( int err )
+{
+  return ( (EXDEV == err) || (EINVAL == err) || (ENOSYS == err) ||
+           (EOPNOTSUPP == err) || (EBADF == err) || (EAGAIN == err) );
+}
+
+
+/*!
+ * \brief   Move everything from fd_in to fd_out through an intermediate pipe,
+ *          for files where neither side is a pipe (e.g. terminals, sockets).
+ * \param   [OUT] *copied       Number of bytes moved to fd_out.
+ * \return  0 on EOF, 1 if splicing is not supported (any more), -1 on error.
+ */
+static int _splice_via_pipe( int fd_out, int fd_in, size_t *copied )
+{
+  int pfd[2];
+  int ret = 0;
+  char drain[8192];
+  ssize_t n, m, left;
+
+  if ( 0 > pipe2( pfd, O_CLOEXEC ) )
+    return ( 1 );
+
+  fcntl( pfd[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE ); // best effort
+
+  while ( 0 < (n = splice( fd_in, NULL, pfd[1], NULL, SPLICE_PIPE_SIZE,
+                           SPLICE_F_MOVE )) ) {
+    for ( left = n; left > 0; left -= m ) {
+      if ( 0 < (m = splice( pfd[0], NULL, fd_out, NULL, left,
+                            SPLICE_F_MOVE )) )
+        continue;
+
+      if ( (0 == m) || ! _zero_copy_unsupported( errno ) ) {
+        n = -1;
+        break;
+      }
+
+      /*!
+       * \brief   The output does not take splice() (e.g. O_APPEND). Once is
+       *          enough to know: Write out what already sits inside the pipe
+       *          and leave the rest to the buffered loop of the caller.
+       */
+      for ( ; left > 0; left -= m ) {
+        m = ((size_t)left < sizeof( drain )) ? left : (ssize_t)sizeof( drain );
+        if ( (0 >= (m = read( pfd[0], drain, m ))) ||
+             (m != full_write( fd_out, drain, m )) )
+          break;
+      }
+
+      if ( 0 == left ) {
+        *copied += n;
+        ret = 1;
+      } else {
+        ret = -1;
+      }
+      goto SPLICE_OUT;
+    }
+
+    if ( 0 > n )
+      break;
+
+    *copied += n;
+  }
+
+  if ( 0 > n )
+    ret = ((0 == *copied) && _zero_copy_unsupported( errno )) ? 1 : -1;
+
+SPLICE_OUT:
+  close( pfd[0] );
+  close( pfd[1] );
+
+  return ( ret );
+}
+
+
+/*!
+ * \brief   Copy fd_in to fd_out till EOF without passing the data through user
+ *          space: copy_file_range() for file to file, sendfile() from a file,
+ *          splice() when either side is a pipe, or through an intermediate pipe
+ *          otherwise.
+ * \param   [OUT] *copied       Number of bytes copied.
+ * \return  0 on EOF, -1 on error. 1 if the kernel cannot copy between these
+ *          files; the caller continues with read()/write() from the current
+ *          file offsets then.
+ */
+static int _zero_copy( int fd_out, int fd_in, size_t *copied )
+{
+  struct stat sin, sout;
+  ssize_t n = -1;
+
+  *copied = 0;
+
+  if ( (0 > fstat( fd_in, &sin )) || (0 > fstat( fd_out, &sout )) )
+    return ( 1 );
+
+  if ( S_ISREG( sin.st_mode ) && S_ISREG( sout.st_mode ) ) {
+    while ( 0 < (n = copy_file_range( fd_in, NULL, fd_out, NULL,
+                                      ZERO_COPY_CHUNK, 0 )) )
+      *copied += n;
+
+    if ( 0 == n )
+      return ( 0 );
+
+    if ( ! _zero_copy_unsupported( errno ) )
+      return ( -1 );
+    // e.g. EXDEV on kernels before 5.3: try sendfile()
+  }
+
+  if ( S_ISREG( sin.st_mode ) ) {
+    while ( 0 < (n = sendfile( fd_out, fd_in, NULL, ZERO_COPY_CHUNK )) )
+      *copied += n;
+  } else if ( S_ISFIFO( sin.st_mode ) || S_ISFIFO( sout.st_mode ) ) {
+    while ( 0 < (n = splice( fd_in, NULL, fd_out, NULL, ZERO_COPY_CHUNK,
+                             SPLICE_F_MOVE )) )
+      *copied += n;
+  } else {
+    return ( _splice_via_pipe( fd_out, fd_in, copied ) );
+  }
+
+  if ( 0 == n )
+    return ( 0 );
+
+  return ( _zero_copy_unsupported( errno ) ? 1 : -1 );
+}
+#endif // __linux__
+
+
+/*!
+ * \brief   Work list of _mmap_translate(). The input is split into chunks of
+ *          MMAP_CHUNK_SIZE bytes, which the worker threads pick in order and
+ *          translate straight to their precomputed place in the output.
+ */
+typedef struct {
+  const char *in;         // mapped input (after the leading odd nibble, if any)
+  char *out;              // mapped output (after the leading odd nibble)
+  size_t in_size;         // bytes to translate
+  int a2h;                // 1: ASCII to HEX, 0: HEX to ASCII
+  size_t chunks;          // number of chunks
+  size_t next;            // next chunk to translate, guarded by lock
+  pthread_mutex_t lock;
+} tMmap_job;
+
+#define MMAP_MIN_SIZE    ( 8*1024*1024 ) // smaller files go the buffered way
+#define MMAP_CHUNK_SIZE  ( 256*1024 )    // input bytes per chunk, cache-sized
+#define MMAP_MAX_THREADS ( 16 )
+
+
+static void *_thr_mmap_translate( void *arg )
+{
+  tMmap_job *job = (tMmap_job*)arg;
+  size_t k, off, n;
+
+  for ( ;; ) {
+    pthread_mutex_lock( &job->lock );
+    k = job->next++;
+    pthread_mutex_unlock( &job->lock );
+
+    if ( k >= job->chunks )
+      break;
+
+    off = k * MMAP_CHUNK_SIZE;
+    n = job->in_size - off;
+    if ( n > MMAP_CHUNK_SIZE )
+      n = MMAP_CHUNK_SIZE;
+
+    /*!
+     * \note   MMAP_CHUNK_SIZE is even, so with ASCII to HEX every chunk holds
+     *         whole character pairs and starts on a pair.
+     */
+    if ( 1 == job->a2h )
+      snprintu8( (uint8_t*)&job->out[off/2], n/2, (char*)&job->in[off], n );
+    else
+      u8nprints( &job->out[2*off], 2*n, (uint8_t*)&job->in[off], n );
+  }
+
+  return ( NULL );
+}
+
+
+/*!
+ * \brief   Get a descriptor of the output file that can be mapped for writing.
+ *          STDOUT redirected by the shell is open write-only, so on Linux the
+ *          file is opened once more for read/write.
+ * \return  The descriptor, fd_out itself or a new one. -1 if not possible.
+ */
+static int _mmap_writable_fd( int fd_out )
+{
+  int fl = fcntl( fd_out, F_GETFL );
+#if defined( __linux__ )
+  char path[32];
+#endif
+
+  if ( (0 <= fl) && (O_RDWR == (fl & O_ACCMODE)) )
+    return ( fd_out );
+
+#if defined( __linux__ )
+  snprintf( path, sizeof( path ), "/proc/self/fd/%i", fd_out );
+  return ( open( path, O_RDWR | O_CLOEXEC ) );
+#else
+  return ( -1 );
+#endif
+}
+
+
+/*!
+ * \brief   Give back the space reserved for a translation that did not take
+ *          place. The output is never cut below its size before.
+ */
+static void _mmap_undo_extend( int fdw, const struct stat *sout, off_t end )
+{
+  if ( end > sout->st_size )
+    ftruncate( fdw, sout->st_size );
+}
+
+
+/*!
+ * \brief   Translate a large regular file to a regular file through memory
+ *          mappings with several threads. The output file is extended to hold
+ *          the translation (blocks allocated) and written at the current offset (or at its end
+ *          with O_APPEND), just like the buffered loop would do.
+ *          With ASCII to HEX the file is handled as one buffer passed to
+ *          snprintu8(): on an odd number of characters the first one makes the
+ *          low nibble of the first byte.
+ * \param   [OUT] *translated   Number of bytes written.
+ * \return  0 on success, -1 on error. 1 if the files are not suitable, the
+ *          caller should go the buffered way then.
+ */
+static int _mmap_translate( int fd_out, int fd_in, int a2h, size_t *translated )
+{
+  struct stat sin, sout;
+  tMmap_job job;
+  pthread_t tid[MMAP_MAX_THREADS];
+  int fdw = -1;
+  int ret = 0;
+  long i, threads;
+  off_t off, base;
+  size_t in_size, out_size, shift = 0;
+  char *in = NULL;
+  char *out = NULL;
+
+  *translated = 0;
+
+  if ( (0 > fstat( fd_in, &sin )) || (0 > fstat( fd_out, &sout )) ||
+       ! S_ISREG( sin.st_mode ) || ! S_ISREG( sout.st_mode ) ||
+       (sin.st_size < MMAP_MIN_SIZE) )
+    return ( 1 );
+
+  if ( fcntl( fd_out, F_GETFL ) & O_APPEND )
+    off = sout.st_size;
+  else if ( 0 > (off = lseek( fd_out, 0, SEEK_CUR )) )
+    return ( 1 );
+
+  // Translate from the current input offset, like read() would:
+  if ( 0 > (base = lseek( fd_in, 0, SEEK_CUR )) || base >= sin.st_size )
+    return ( 1 );
+
+  in_size = (size_t)(sin.st_size - base);
   if ( 1 == a2h ) {
-    if ( NULL == (hcat_tbuf = malloc( BIG_BUFFER_SIZE/2 + 1 )) )
-      err_sys( "Not enough space for translation buffer" );
-  } else if ( 1 == h2a ) { // indeed tbuf is double bigbuf
+    shift = in_size % 2;
+    out_size = in_size/2 + shift;
+  } else {
+    out_size = 2*in_size;
+  }
+
+  if ( 0 > (fdw = _mmap_writable_fd( fd_out )) )
+    return ( 1 );
+
+  /*!
+   * \brief   Reserve the blocks: A store to a sparse page on a full file system
+   *          would raise SIGBUS, where write() returns ENOSPC. Data behind the
+   *          translation stays, as write() would just overwrite up to there.
+   */
+  if ( 0 != posix_fallocate( fdw, off, (off_t)out_size ) ) {
+    _mmap_undo_extend( fdw, &sout, off + (off_t)out_size );
+    ret = 1;
+    goto MMAP_OUT;
+  }
+
+  // Mappings start on a page boundary, so map from there:
+  in = (char*)mmap( NULL, in_size + (base % sysconf( _SC_PAGESIZE )),
+                    PROT_READ, MAP_PRIVATE, fd_in,
+                    base - (base % sysconf( _SC_PAGESIZE )) );
+  out = (char*)mmap( NULL, out_size + (off % sysconf( _SC_PAGESIZE )),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fdw,
+                     off - (off % sysconf( _SC_PAGESIZE )) );
+
+  if ( (MAP_FAILED == in) || (MAP_FAILED == out) ) {
+    _mmap_undo_extend( fdw, &sout, off + (off_t)out_size ); // nothing written
+    ret = 1;
+    goto MMAP_OUT;
+  }
+
+  madvise( in, in_size + (base % sysconf( _SC_PAGESIZE )), MADV_WILLNEED );
+
+  job.in  = in + (base % sysconf( _SC_PAGESIZE ));
+  job.out = out + (off % sysconf( _SC_PAGESIZE ));
+
+  // The odd character is the low nibble of the first byte:
+  if ( 1 == shift ) {
+    snprintu8( (uint8_t*)job.out, 1, (char*)job.in, 1 );
+    job.in++;
+    job.out++;
+  }
+
+  job.in_size = in_size - shift;
+  job.a2h = a2h;
+  job.chunks = (job.in_size + MMAP_CHUNK_SIZE - 1) / MMAP_CHUNK_SIZE;
+  job.next = 0;
+  pthread_mutex_init( &job.lock, NULL );
+
+  if ( 1 > (threads = sysconf( _SC_NPROCESSORS_ONLN )) )
+    threads = 1;
+  if ( threads > MMAP_MAX_THREADS )
+    threads = MMAP_MAX_THREADS;
+  if ( threads > (long)job.chunks )
+    threads = (long)job.chunks;
+
+  // The calling thread works as well:
+  for ( i=1; i<threads; i++ ) {
+    if ( 0 != pthread_create( &tid[i], NULL, _thr_mmap_translate, &job ) )
+      break;
+  }
+  threads = i;
+
+  _thr_mmap_translate( &job );
+
+  for ( i=1; i<threads; i++ )
+    pthread_join( tid[i], NULL );
+
+  pthread_mutex_destroy( &job.lock );
+
+  // Leave both files where read() and write() would have left them:
+  lseek( fd_in, 0, SEEK_END );
+  if ( ! (fcntl( fd_out, F_GETFL ) & O_APPEND) )
+    lseek( fd_out, off + (off_t)out_size, SEEK_SET );
+
+  *translated = out_size;
+
+MMAP_OUT:
+  if ( (NULL != in) && (MAP_FAILED != in) )
+    munmap( in, in_size + (base % sysconf( _SC_PAGESIZE )) );
+  if ( (NULL != out) && (MAP_FAILED != out) )
+    munmap( out, out_size + (off % sysconf( _SC_PAGESIZE )) );
+  if ( fdw != fd_out )
+    close( fdw );
+
+  return ( ret );
+}
+
+
+#define BIG_BUFFER_SIZE ( 128*1024*sizeof( char ) ) // slot size, reads adapt
+#define HCAT_SLOTS      ( 3 ) // triple buffering of the read/write pipeline
+
+
+/*!
+ * \brief   Ring of read buffers shared by the reader thread of _hcat_pipeline()
+ *          and the translating/writing caller. Slots are filled and consumed
+ *          strictly in order, so the output stays byte-exact.
+ */
+typedef struct {
+  int fd;                     // file to read from
+  char *buf[HCAT_SLOTS];      // slot buffers of BIG_BUFFER_SIZE bytes
+  tIobuf io;                  // read size, up to BIG_BUFFER_SIZE
+  ssize_t len[HCAT_SLOTS];    // read() result per slot, 0: EOF, -1: error
+  size_t head;                // slots filled by the reader
+  size_t tail;                // slots consumed by the writer
+  int stop;                   // writer does not take any more slots
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t drained;
+} tHcat_ring;
+
+
+static void *_thr_hcat_reader( void *arg )
+{
+  tHcat_ring *r = (tHcat_ring*)arg;
+  size_t slot;
+  ssize_t n;
+
+  do {
+    pthread_mutex_lock( &r->lock );
+    while ( (HCAT_SLOTS == r->head - r->tail) && (0 == r->stop) )
+      pthread_cond_wait( &r->drained, &r->lock );
+    slot = r->head % HCAT_SLOTS;
+    n = (0 == r->stop) ? 1 : 0;
+    pthread_mutex_unlock( &r->lock );
+
+    if ( 0 == n )
+      break;
+
+    n = nonblock_immune_read( r->fd, r->buf[slot], r->io.size );
+    iobuf_adapt( &r->io, n );
+
+    pthread_mutex_lock( &r->lock );
+    r->len[slot] = n;
+    r->head++;
+    pthread_cond_signal( &r->filled );
+    pthread_mutex_unlock( &r->lock );
+  } while ( n > 0 );
+
+  return ( NULL );
+}
+
+
+/*!
+ * \brief   Hexdump state of hcat(). Lines and offsets run on over read() and
+ *          file boundaries, as if the files were concatenated first.
+ */
+typedef struct {
+  const tHexdump_fmt *fmt;          // NULL: no hexdump
+  uint64_t offset;                  // offset of the next line
+  size_t npend;                     // bytes of an incomplete line
+  uint8_t pend[HEXDUMP_MAX_COLS];
+} tHcat_dump;
+
+
+/*!
+ * \brief   Render the lines completed by n more bytes to hcat_tbuf and write
+ *          them. The rest is kept for the next call.
+ * \return  Number of characters written, -1 on error.
+ */
+static ssize_t _hcat_dump( int fd_concat, tHcat_dump *d, const uint8_t *in,
+                           size_t n )
+{
+  const size_t cols = d->fmt->cols;
+  char *o = (char*)hcat_tbuf;
+  size_t take;
+
+  if ( d->npend > 0 ) {
+    take = (n < cols - d->npend) ? n : cols - d->npend;
+    memcpy( &d->pend[d->npend], in, take );
+    d->npend += take;
+    in += take;
+    n -= take;
+
+    if ( d->npend < cols )
+      return ( 0 ); // input used up
+
+    o += hexdump_line( o, d->pend, cols, d->offset, d->fmt );
+    d->offset += cols;
+    d->npend = 0;
+  }
+
+  for ( ; n >= cols; in += cols, n -= cols ) {
+    o += hexdump_line( o, in, cols, d->offset, d->fmt );
+    d->offset += cols;
+  }
+
+  memcpy( d->pend, in, n );
+  d->npend = n;
+
+  return ( full_write( fd_concat, hcat_tbuf, (size_t)(o - (char*)hcat_tbuf) ) );
+}
+
+
+/*!
+ * \brief   Write the last, incomplete line of the hexdump.
+ */
+static ssize_t _hcat_dump_flush( int fd_concat, tHcat_dump *d )
+{
+  size_t n;
+
+  if ( 0 == d->npend )
+    return ( 0 );
+
+  n = hexdump_line( (char*)hcat_tbuf, d->pend, d->npend, d->offset, d->fmt );
+  d->offset += d->npend;
+  d->npend = 0;
+
+  return ( full_write( fd_concat, hcat_tbuf, n ) );
+}
+
+
+/*!
+ * \brief   Buffered read/translate/write of one file. A reader thread keeps up
+ *          to HCAT_SLOTS buffers filled ahead, while the caller translates and
+ *          writes the oldest one.
+ * \return  0 on EOF, -1 on read or write error.
+ */
+static int _hcat_pipeline( int fd_concat, int fd, int a2h, int h2a,
+                           tHcat_dump *dump, int verbose, const char *name )
+{
+  tHcat_ring r;
+  pthread_t reader;
+  size_t nwrite = 0;
+  ssize_t nread = 0;
+  ssize_t nwritten = 0;
+  char *rbuf;
+  tHex_decoder dec;
+  struct stat st;
+  off_t pos;
+  int lead = 0;
+  int i;
+
+  /*!
+   * \brief   The size of a regular file is known ahead. With an odd number of
+   *          characters left, the first one gets a leading zero nibble, just
+   *          like snprintu8() and the memory-mapped translation do.
+   */
+  if ( (1 == a2h) && (0 == fstat( fd, &st )) && S_ISREG( st.st_mode ) &&
+       (0 <= (pos = lseek( fd, 0, SEEK_CUR ))) && (pos < st.st_size) )
+    lead = (int)((st.st_size - pos) % 2);
+
+  hex_decoder_init( &dec, (2 == a2h) ? 1 : 0, lead );
+
+  for ( i=0; i<HCAT_SLOTS; i++ )
+    r.buf[i] = (char*)hcat_bigbuf + i*BIG_BUFFER_SIZE;
+
+  r.fd = fd;
+  iobuf_init( &r.io, fd, BIG_BUFFER_SIZE, 0 ); // storage is the slots
+  r.head = r.tail = 0;
+  r.stop = 0;
+  pthread_mutex_init( &r.lock, NULL );
+  pthread_cond_init( &r.filled, NULL );
+  pthread_cond_init( &r.drained, NULL );
+
+#if defined( POSIX_FADV_SEQUENTIAL )
+  posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL ); // fails on pipes, fine
+#endif
+
+  if ( 0 != pthread_create( &reader, NULL, _thr_hcat_reader, &r ) )
+    err_sys( "Cannot create reader thread" );
+
+  /*!
+   * \brief   Due to limitted buffer size (*bigbuf), we continue buffered
+   *          read/write until reading from input file has reached EOF.
+   */
+  do {
+    pthread_mutex_lock( &r.lock );
+    while ( r.head == r.tail )
+      pthread_cond_wait( &r.filled, &r.lock );
+    rbuf = r.buf[r.tail % HCAT_SLOTS];
+    nread = r.len[r.tail % HCAT_SLOTS];
+    pthread_mutex_unlock( &r.lock );
+
+    if ( nread > 0 ) {
+      if ( 0 != a2h ) {
+        // ASCII to HEX, in place (the slot is ours until handed back):
+        nwrite = hex_decode_stream( &dec, (uint8_t*)rbuf, rbuf,
+                                    (size_t)nread );
+
+        nwritten = full_write( fd_concat, rbuf, nwrite );
+      } else if ( NULL != dump->fmt ) {
+        nwritten = _hcat_dump( fd_concat, dump, (uint8_t*)rbuf, (size_t)nread );
+      } else if ( 1 == h2a ) {
+        _bflush( hcat_tbuf, nread*2, &ascii_null );
+        //_bflush( tbuf, BIG_BUFFER_SIZE*2, &ascii_null );
+
+        // HEX to ASCII:
+        nwrite = u8nprints( (char*)hcat_tbuf, ((size_t)nread)*2, \
+                            (uint8_t*)rbuf, (size_t)nread );
+
+        nwritten = full_write( fd_concat, hcat_tbuf, nwrite );
+      } else {
+        nwritten = full_write( fd_concat, rbuf, nread );
+      }
+
+      if ( verbose == 1 ) {
+        fprintf( stderr, "\n%i bytes read from %s\n", (int)nread, name );
+        fprintf( stderr, "%i bytes transferred\n", (int)nwritten );
+      }
+
+      // Output is gone (EPIPE), no use in reading the rest:
+      if ( nwritten < 0 ) {
+        pthread_mutex_lock( &r.lock );
+        r.stop = 1;
+        pthread_cond_signal( &r.drained );
+        pthread_mutex_unlock( &r.lock );
+        nread = -1;
+        break;
+      }
+    } else if ( (0 == nread) && (0 != a2h) ) {
+      // A lone character at the end of the file is the last byte:
+      if ( 1 == hex_decode_flush( &dec, (uint8_t*)rbuf ) )
+        full_write( fd_concat, rbuf, 1 );
+    }
+
+    // Hand the slot back to the reader:
+    pthread_mutex_lock( &r.lock );
+    r.tail++;
+    pthread_cond_signal( &r.drained );
+    pthread_mutex_unlock( &r.lock );
+  } while ( nread > 0 );
+
+  pthread_join( reader, NULL ); // reader stopped on EOF, error or stop
+
+  pthread_mutex_destroy( &r.lock );
+  pthread_cond_destroy( &r.filled );
+  pthread_cond_destroy( &r.drained );
+
+  return ( (nread < 0) ? -1 : 0 );
+}
+
+
+/*!
+ * \brief   Open the file following the one in progress ahead of time and ask
+ *          the kernel to read it in meanwhile. Errors are left to the regular
+ *          open, that reports them when it comes to this file. Regular files
+ *          only: Opening a FIFO or a device early may block or have effects
+ *          before the file in progress is written.
+ * \return  The file descriptor, -1 if nothing was opened.
+ */
+static int _hcat_prefetch( const char *filename )
+{
+  struct stat st;
+  int fd = -1;
+
+  if ( (NULL == filename) || (0 == strcmp( filename, standard_input )) )
+    return ( -1 );
+
+  // O_NONBLOCK: A FIFO without writer must not stop us here.
+  if ( 0 > (fd = open( filename, O_RDONLY | O_NONBLOCK )) )
+    return ( -1 );
+
+  if ( (0 > fstat( fd, &st )) || !S_ISREG( st.st_mode ) ) {
+    close( fd );
+    return ( -1 );
+  }
+
+  fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_NONBLOCK );
+
+#if defined( POSIX_FADV_WILLNEED )
+  posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+#endif
+
+  return ( fd );
+}
+
+
+int hcat( int fd_concat, char **argv, int a2h, int h2a,
+          const tHexdump_fmt *dump, int verbose )
+{
+  int fd = STDIN_FILENO;
+  int fd_next = -1;  // next file, opened ahead
+  int retval = EXIT_SUCCESS;
+  size_t ncopied = 0;
+  ssize_t nread = 0;
+  tHcat_dump d;
+
+  d.fmt = (0 == a2h) ? dump : NULL;
+  d.offset = 0;
+  d.npend = 0;
+
+  hcat_tbuf = NULL;
+  if ( NULL == (hcat_bigbuf = malloc( HCAT_SLOTS*BIG_BUFFER_SIZE )) )
+    err_sys( "Not enough space for concatenation buffers" );
+
+  // ASCII to HEX translates in place, HEX to ASCII needs double space:
+  if ( NULL != d.fmt ) {
+    // Lines completed by one full read, plus the one pending before:
+    if ( NULL == (hcat_tbuf = malloc( (BIG_BUFFER_SIZE/d.fmt->cols + 1) *
+                                      hexdump_line_size( d.fmt ) )) )
+      err_sys( "Not enough space for hexdump buffer" );
+  } else if ( (0 == a2h) && (1 == h2a) ) {
     if ( NULL == (hcat_tbuf = malloc( BIG_BUFFER_SIZE*2 )) )
       err_sys( "Not enough space for translation buffer" );
   }
 
   /*!
-   * \brief   For each filename in **argv, append the file to resulting file. We
-   *          continue concatenating or translating from ASCII to HEX (or vice
-   *          versa) aslong no errors occur during file-processing.
+   * \brief   For each filename in **argv, append the file to resulting file. We
+   *          continue concatenating or translating from ASCII to HEX (or vice
+   *          versa) aslong no errors occur during file-processing.
+   */
+  do {
+    if ( 0 > (fd = fd_next) ) {
+      fd = open_for_read_or_warn_stdin( *argv, verbose );
+    } else if ( 1 == verbose ) {
+      fprintf( stderr, "Warning: %s FD=%i is not stdin\n", *argv, fd );
+    }
+
+    if ( fd < 0 ) {
+      goto HCAT_ERROR_OUT;
+    } else {
+      fd_next = _hcat_prefetch( argv[1] );
+      nread = 1; // not at EOF yet
+
+      /*!
+       * \brief   Large regular files are translated in parallel through memory
+       *          mappings. Anything else goes the buffered way below.
+       */
+      if ( (1 == a2h) || ((0 == a2h) && (1 == h2a) && (NULL == d.fmt)) ) {
+        switch ( _mmap_translate( fd_concat, fd, a2h, &ncopied ) ) {
+          case 0  : nread = 0;  break;
+          case -1 : nread = -1; break;
+        }
+
+        if ( (verbose == 1) && (ncopied > 0) )
+          fprintf( stderr, "\n%lu bytes translated from %s\n",
+                   (unsigned long)ncopied, *argv );
+      }
+
+    #if defined( __linux__ )
+      /*!
+       * \brief   Without translation, let the kernel copy the file. Where it
+       *          cannot, the buffered loop below takes over from the current
+       *          file offsets.
+       */
+      if ( (0 == a2h) && (1 != h2a) && (NULL == d.fmt) ) {
+        switch ( _zero_copy( fd_concat, fd, &ncopied ) ) {
+          case 0  : nread = 0;  break;
+          case -1 : nread = -1; break;
+        }
+
+        if ( (verbose == 1) && (ncopied > 0) )
+          fprintf( stderr, "\n%lu bytes copied from %s\n",
+                   (unsigned long)ncopied, *argv );
+      }
+    #endif
+
+      if ( nread > 0 )
+        nread = _hcat_pipeline( fd_concat, fd, a2h, h2a, &d, verbose, *argv );
+
+      if ( fd != STDIN_FILENO )
+        close( fd );
+
+      if ( nread < 0 )
+        goto HCAT_ERROR_OUT;
+
+      fflush( stdout );
+      continue;
+    }
+
+    HCAT_ERROR_OUT:
+      retval = EXIT_FAILURE;
+      break;
+  } while ( *++argv ); // continue processing next file, if any
+
+  // Last line of the hexdump:
+  if ( (NULL != d.fmt) && (0 > _hcat_dump_flush( fd_concat, &d )) )
+    retval = EXIT_FAILURE;
+
+  if ( 0 <= fd_next )
+    close( fd_next );
+
+  free( hcat_tbuf );
+  free( hcat_bigbuf );
+
+  // Make it bullet-proof:
+  hcat_tbuf = NULL;
+  hcat_bigbuf = NULL;
+
+  return retval;
+}
+
+
+#define LOOP_MAX_FDS    ( 4 )  // fd_in, fd_dev_read, fd_dev_write, pacing
+#define LOOP_MAX_EVENTS ( 8 )
+
+/*!
+ * \brief   A file descriptor watched by the epoll engine. The device may be
+ *          read and written through the same descriptor (PTY master), so the
+ *          interest of both directions is merged per descriptor.
+ */
+typedef struct {
+  int fd;
+  uint32_t want;            // events wanted in this round
+  uint32_t have;            // events registered at the epoll instance
+  int always;               // cannot be polled (regular file), always ready
+} tLoop_watch;
+
+
+typedef struct {
+  int ep;                   // epoll instance
+  int n;
+  tLoop_watch w[LOOP_MAX_FDS];
+} tLoop_set;
+
+
+/*!
+ * \brief   State of pty_loop() shared by the engines.
+ */
+typedef struct {
+  const tPty_loop *cfg;
+  tIobuf in;                // fd_in read buffer
+  tIobuf dev;               // fd_dev_read read buffer
+  tHex_decoder dec;
+  char *tbuf;               // HEX to ASCII translation buffer
+  size_t tbsize;
+  size_t lfsize;
+  struct iovec pend_iov[2]; // device write in progress
+  struct iovec *pend;
+  int npend;
+  int held;                 // pend held back by the pacing, timer armed
+  struct iovec out_iov[2];  // fd_out write in progress (io_uring)
+  struct iovec *out;
+  int nout;
+  ssize_t nraw;             // last fd_in read, for iobuf_adapt()
+  int in_open;
+  int dev_open;
+  int sfd;                  // signalfd
+  int pfd;                  // pidfd of the child, -1 if none
+  int exited;               // 1: child has ended, 2: reaped already
+  int status;
+  int retval;
+  tRecord *rec;             // NULL: not recording (any more)
+} tLoop_state;
+
+
+static void _loop_stop( tLoop_state *st )
+{
+  st->dev_open = st->in_open = 0;
+  st->npend = st->nout = 0;
+}
+
+
+/*!
+ * \brief   After EOF, a terminal may deliver more (a typed ^D), so it stays
+ *          watched with ignore_eof. Pipes and files would report EOF forever.
+ */
+static int _loop_keep_after_eof( int fd, int ignore_eof )
+{
+  return ( (1 == ignore_eof) && (1 == isatty( fd )) );
+}
+
+
+/*!
+ * \brief   Record the device I/O. A recording that cannot be written is
+ *          given up, the session goes on.
+ */
+static void _loop_record( tLoop_state *st, int dir, const struct iovec *iov,
+                          int iovcnt )
+{
+  if ( (NULL != st->rec) && (0 > rec_writev( st->rec, dir, iov, iovcnt )) ) {
+    err_msg( "Cannot write the recording, stopped" );
+    st->rec = NULL;
+  }
+}
+
+
+/*!
+ * \brief   Data of fd_in arrived in the read buffer: Translate it in place and
+ *          queue it for the device, with linefeed.
+ */
+static void _loop_in_data( tLoop_state *st, ssize_t n )
+{
+  char *esc;
+
+  // Escape: Send what is in front of it, then leave:
+  if ( (0 <= st->cfg->escape) &&
+       (NULL != (esc = (char*)memchr( st->in.buf, st->cfg->escape,
+                                      (size_t)n ))) ) {
+    n = esc - st->in.buf;
+    st->in_open = st->dev_open = 0;
+  }
+
+  if ( (1 == st->cfg->nolf) && (n > 0) )
+    n -= 1;
+
+  // ASCII to HEX, in place:
+  if ( 1 == st->cfg->translate )
+    n = (ssize_t)hex_decode_stream( &st->dec, (uint8_t*)st->in.buf,
+                                    st->in.buf, (size_t)n );
+
+  st->pend = st->pend_iov;
+  st->pend[0].iov_base = st->in.buf;
+  st->pend[0].iov_len = (size_t)n;
+  st->pend[1].iov_base = (void*)st->cfg->linefeed;
+  st->pend[1].iov_len = st->lfsize;
+  st->npend = 2;
+
+  _iov_consume( &st->pend, &st->npend, 0 ); // drop empty parts
+  _loop_record( st, REC_IN, st->pend, st->npend );
+}
+
+
+static void _loop_in_eof( tLoop_state *st )
+{
+  // A lone character at the end of the input is the last byte:
+  if ( (1 == st->cfg->translate) &&
+       (1 == hex_decode_flush( &st->dec, (uint8_t*)st->in.buf )) ) {
+    st->pend = st->pend_iov;
+    st->pend[0].iov_base = st->in.buf;
+    st->pend[0].iov_len = 1;
+    st->npend = 1;
+    _loop_record( st, REC_IN, st->pend, st->npend );
+  }
+
+  if ( 0 == _loop_keep_after_eof( st->cfg->fd_in, st->cfg->ignore_eof ) )
+    st->in_open = 0;
+}
+
+
+/*!
+ * \brief   Data of the device arrived in the read buffer: Translate it and
+ *          queue it for fd_out, with linefeed.
+ */
+static void _loop_dev_data( tLoop_state *st, ssize_t n )
+{
+  size_t nwrite;
+  void *p;
+
+  st->out = st->out_iov;
+  st->out[0].iov_base = st->dev.buf;
+  st->out[0].iov_len = (size_t)n;
+  _loop_record( st, REC_OUT, st->out, 1 );
+
+  if ( 1 == st->cfg->translate ) {
+    // Translation buffer is twice as big as the read buffer:
+    if ( st->tbsize < st->dev.size*2 ) {
+      if ( NULL == (p = realloc( st->tbuf, st->dev.size*2 )) )
+        err_sys( "Not enough space for translation buffer" );
+      st->tbuf = (char*)p;
+      st->tbsize = st->dev.size*2;
+    }
+
+    // HEX to ASCII:
+    nwrite = u8nprints( st->tbuf, st->tbsize, (uint8_t*)st->dev.buf,
+                        (size_t)n );
+    st->out[0].iov_base = st->tbuf;
+    st->out[0].iov_len = nwrite;
+  } else {
+    st->out[0].iov_base = st->dev.buf;
+    st->out[0].iov_len = (size_t)n;
+  }
+
+  st->out[1].iov_base = (void*)st->cfg->linefeed;
+  st->out[1].iov_len = st->lfsize;
+  st->nout = 2;
+
+  _iov_consume( &st->out, &st->nout, 0 );
+}
+
+
+/*!
+ * \brief   Write the pending input to the device, as much as the pacing
+ *          allows. Held back, the pacing timer is armed.
+ * \return  Bytes written, 0 if held back, -1 on error with errno set.
+ */
+static ssize_t _loop_dev_write( tLoop_state *st )
+{
+  tPace *pace = st->cfg->pace;
+  struct iovec iov[2];
+  uint64_t due;
+  size_t n, len = 0;
+  ssize_t w;
+  int i;
+
+  if ( NULL == pace ) {
+    w = writev( st->cfg->fd_dev_write, st->pend, st->npend );
+  } else {
+    for ( i=0; i<st->npend; i++ )
+      len += st->pend[i].iov_len;
+
+    if ( 0 == (n = pace_allow( pace, len, &due )) ) {
+      if ( 0 > pace_arm( pace, due ) )
+        return ( -1 );
+      st->held = 1;
+      return ( 0 );
+    }
+
+    // The first n bytes of the pending parts:
+    for ( i=0; (i<st->npend) && (n > 0); i++ ) {
+      iov[i] = st->pend[i];
+      if ( iov[i].iov_len > n )
+        iov[i].iov_len = n;
+      n -= iov[i].iov_len;
+    }
+
+    if ( 0 < (w = writev( st->cfg->fd_dev_write, iov, i )) )
+      pace_sent( pace, (size_t)w );
+  }
+
+  if ( w > 0 )
+    _iov_consume( &st->pend, &st->npend, (size_t)w );
+
+  return ( w );
+}
+
+
+/*!
+ * \brief   Read the device and copy it to fd_out, blocking on fd_out.
+ * \return  Bytes read, 0 on EOF, -1 on error with errno set. EAGAIN and
+ *          EINTR are no errors, they return -2.
+ */
+static ssize_t _loop_dev_to_out( tLoop_state *st )
+{
+  ssize_t n;
+
+  if ( 0 > (n = read( st->cfg->fd_dev_read, st->dev.buf, st->dev.size )) )
+    return ( ((EAGAIN == errno) || (EINTR == errno)) ? -2 : -1 );
+
+  if ( n > 0 ) {
+    _loop_dev_data( st, n );
+
+    if ( (st->nout > 0) && (0 > full_writev( st->cfg->fd_out, st->out,
+                                             st->nout )) )
+      err_sys( "Write failure (FD=%i) ", st->cfg->fd_out );
+    st->nout = 0;
+  }
+
+  iobuf_adapt( &st->dev, n );
+
+  return ( n );
+}
+
+
+static void _loop_signal( tLoop_state *st, const struct signalfd_siginfo *si )
+{
+  if ( SIGCHLD != si->ssi_signo )
+    _loop_stop( st ); // terminate
+  else if ( st->cfg->child == waitpid( st->cfg->child, &st->status, WNOHANG ) )
+    st->exited = 2;   // reaped already
+}
+
+
+static tLoop_watch *_loop_watch( tLoop_set *set, int fd )
+{
+  int i;
+
+  for ( i=0; i<set->n; i++ )
+    if ( fd == set->w[i].fd )
+      return ( &set->w[i] );
+
+  set->w[set->n].fd = fd;
+  set->w[set->n].want = set->w[set->n].have = 0;
+  set->w[set->n].always = 0;
+
+  return ( &set->w[set->n++] );
+}
+
+
+/*!
+ * \brief   Bring the epoll registrations in line with the wanted events.
+ * \return  1 if an always ready descriptor is wanted (do not block), 0 if
+ *          not, -1 on error.
+ */
+static int _loop_commit( tLoop_set *set )
+{
+  struct epoll_event ev;
+  tLoop_watch *w;
+  int i, op, ready = 0;
+
+  for ( i=0; i<set->n; i++ ) {
+    w = &set->w[i];
+
+    if ( (1 == w->always) || (w->want == w->have) ) {
+      if ( (1 == w->always) && (0 != w->want) )
+        ready = 1;
+      continue;
+    }
+
+    // No interest is a removal, or EPOLLHUP would still be reported:
+    if ( 0 == w->have )
+      op = EPOLL_CTL_ADD;
+    else if ( 0 == w->want )
+      op = EPOLL_CTL_DEL;
+    else
+      op = EPOLL_CTL_MOD;
+
+    ev.events = w->want;
+    ev.data.fd = w->fd;
+
+    if ( 0 > epoll_ctl( set->ep, op, w->fd, &ev ) ) {
+      if ( (EPERM == errno) && (EPOLL_CTL_ADD == op) ) {
+        w->always = 1; // regular file
+        ready = 1;
+        continue;
+      }
+      return ( -1 );
+    }
+
+    w->have = w->want;
+  }
+
+  return ( ready );
+}
+
+
+/*!
+ * \brief   Readiness based engine of pty_loop(): epoll_wait(), then read() and
+ *          write() per descriptor.
+ */
+static void _loop_epoll( tLoop_state *st )
+{
+  const tPty_loop *cfg = st->cfg;
+  struct epoll_event ev[LOOP_MAX_EVENTS];
+  struct signalfd_siginfo si;
+  tLoop_set set;
+  ssize_t n;
+  int wflags = -1;                  // fd_dev_write flags to restore
+  int block;
+  int rin, rdev, wdev;
+  int i, k;
+
+  if ( 0 > (set.ep = epoll_create1( EPOLL_CLOEXEC )) )
+    err_sys( "Cannot create epoll instance" );
+  set.n = 0;
+
+  ev[0].events = EPOLLIN;
+  ev[0].data.fd = st->sfd;
+  if ( 0 > epoll_ctl( set.ep, EPOLL_CTL_ADD, st->sfd, &ev[0] ) )
+    err_sys( "Cannot watch signal descriptor" );
+
+  if ( 0 <= st->pfd ) {
+    ev[0].data.fd = st->pfd;
+    if ( 0 > epoll_ctl( set.ep, EPOLL_CTL_ADD, st->pfd, &ev[0] ) )
+      err_sys( "Cannot watch child process" );
+  }
+
+  /*!
+   * \note    The device is written non-blocking, otherwise a program not
+   *          reading its input could block us from reading its output. The
+   *          descriptors 0..2 are shared with the invoking shell and stay as
+   *          they are.
    */
-  do {
-    fd = open_for_read_or_warn_stdin( *argv, verbose );
+  if ( cfg->fd_dev_write > STDERR_FILENO ) {
+    if ( 0 <= (wflags = fcntl( cfg->fd_dev_write, F_GETFL )) )
+      fcntl( cfg->fd_dev_write, F_SETFL, wflags | O_NONBLOCK );
+  }
 
-    if ( fd < 0 ) {
-      goto HCAT_ERROR_OUT;
-    } else {
-      /*!
-       * \brief   Due to limitted buffer size (*bigbuf), we continue buffered
-       *          read/write until reading from input file has reached EOF.
-       */
-      do {
-        nread = nonblock_immune_read( fd, hcat_bigbuf, BIG_BUFFER_SIZE );
-
-        if ( nread > 0 ) {
-          if ( 1 == a2h ) {
-            _bflush( hcat_tbuf, nread/2 + 1, &ascii_null );
-            //_bflush( tbuf, BIG_BUFFER_SIZE/2 + 1, &ascii_null );
-
-            // ASCII to HEX:
-            nwrite = snprintu8( (uint8_t*)hcat_tbuf, ((size_t)nread)/2 + \
-                                ((size_t)nread)%2, (char*)hcat_bigbuf, \
-                                (size_t)nread );
-
-            nwritten = full_write( fd_concat, hcat_tbuf, nwrite );
-          } else if ( 1 == h2a ) {
-            _bflush( hcat_tbuf, nread*2, &ascii_null );
-            //_bflush( tbuf, BIG_BUFFER_SIZE*2, &ascii_null );
-
-            // HEX to ASCII:
-            nwrite = u8nprints( (char*)hcat_tbuf, ((size_t)nread)*2, \
-                                (uint8_t*)hcat_bigbuf, (size_t)nread );
-
-            nwritten = full_write( fd_concat, hcat_tbuf, nwrite );
-          } else {
-            nwritten = full_write( fd_concat, hcat_bigbuf, nread );
-          }
-
-          if ( verbose == 1 ) {
-            fprintf( stderr, "\n%i bytes read from %s\n", (int)nread, *argv );
-            fprintf( stderr, "%i bytes transferred\n", (int)nwritten );
-          }
-        }
-      } while ( (nread > 0) && (nread < (ssize_t)BIG_BUFFER_SIZE) );
+  while ( ((1 == st->in_open) || (st->npend > 0) || (1 == st->dev_open)) &&
+          (0 == st->exited) ) {
+    // Interest of this round:
+    for ( i=0; i<set.n; i++ )
+      set.w[i].want = 0;
+
+    if ( (1 == st->in_open) && (0 == st->npend) )
+      _loop_watch( &set, cfg->fd_in )->want |= EPOLLIN;
+    if ( (st->npend > 0) && (1 == st->held) )
+      _loop_watch( &set, cfg->pace->tfd )->want |= EPOLLIN;
+    else if ( st->npend > 0 )
+      _loop_watch( &set, cfg->fd_dev_write )->want |= EPOLLOUT;
+    if ( 1 == st->dev_open )
+      _loop_watch( &set, cfg->fd_dev_read )->want |= EPOLLIN;
+
+    if ( 0 > (block = _loop_commit( &set )) )
+      err_sys( "Cannot watch file descriptors" );
+
+    if ( 0 > (k = epoll_wait( set.ep, ev, LOOP_MAX_EVENTS,
+                              (1 == block) ? 0 : -1 )) ) {
+      if ( EINTR == errno )
+        continue;
+      err_sys( "Event loop failure" );
+    }
 
-      if ( fd != STDIN_FILENO )
-        close( fd );
+    rin = rdev = wdev = 0;
 
-      if ( nread < 0 )
-        goto HCAT_ERROR_OUT;
+    for ( i=0; i<set.n; i++ ) {
+      if ( 0 == set.w[i].always )
+        continue;
+      if ( (set.w[i].fd == cfg->fd_in) && (set.w[i].want & EPOLLIN) )
+        rin = 1;
+      if ( (set.w[i].fd == cfg->fd_dev_read) && (set.w[i].want & EPOLLIN) )
+        rdev = 1;
+      if ( (set.w[i].fd == cfg->fd_dev_write) && (set.w[i].want & EPOLLOUT) )
+        wdev = 1;
+    }
 
-      fflush( stdout );
-      continue;
+    for ( i=0; i<k; i++ ) {
+      if ( st->sfd == ev[i].data.fd ) {
+        while ( sizeof( si ) == read( st->sfd, &si, sizeof( si ) ) )
+          _loop_signal( st, &si );
+      } else if ( st->pfd == ev[i].data.fd ) {
+        st->exited = 1;
+      } else if ( (NULL != cfg->pace) && (cfg->pace->tfd == ev[i].data.fd) ) {
+        pace_expired( cfg->pace );
+        st->held = 0;
+        wdev = 1;
+      } else {
+        if ( (ev[i].data.fd == cfg->fd_in) &&
+             (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) )
+          rin = 1;
+        if ( (ev[i].data.fd == cfg->fd_dev_read) &&
+             (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) )
+          rdev = 1;
+        if ( (ev[i].data.fd == cfg->fd_dev_write) &&
+             (ev[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) )
+          wdev = 1;
+      }
     }
 
-    HCAT_ERROR_OUT:
-      retval = EXIT_FAILURE;
-      break;
-  } while ( *++argv ); // continue processing next file, if any
+    // Device to user:
+    if ( (1 == rdev) && (1 == st->dev_open) ) {
+      n = _loop_dev_to_out( st );
 
-  free( hcat_tbuf );
-  free( hcat_bigbuf );
+      if ( (-1 == n) && (EIO != errno) ) { // EIO: PTY slave closed
+        err_msg( "Read failure on device FD=%i", cfg->fd_dev_read );
+        st->retval = -1;
+      }
 
-  // Make it bullet-proof:
-  hcat_tbuf = NULL;
-  hcat_bigbuf = NULL;
+      if ( ((0 == n) && (0 == _loop_keep_after_eof( cfg->fd_dev_read,
+                                                    cfg->ignore_eof ))) ||
+           (-1 == n) )
+        _loop_stop( st ); // device is gone, nothing to send to
+    }
 
-  return retval;
+    // User to device, continue a pending write:
+    if ( (1 == wdev) && (st->npend > 0) && (0 == st->held) ) {
+      if ( (0 > (n = _loop_dev_write( st ))) &&
+           (EAGAIN != errno) && (EINTR != errno) ) {
+        err_msg( "Write failure (FD=%i) ", cfg->fd_dev_write );
+        _loop_stop( st );
+        st->retval = -1;
+      }
+
+      if ( 0 == st->npend )
+        iobuf_adapt( &st->in, st->nraw ); // buffer is free again
+    }
+
+    if ( (1 == rin) && (1 == st->in_open) && (0 == st->npend) ) {
+      if ( 0 < (n = st->nraw = read( cfg->fd_in, st->in.buf, st->in.size )) ) {
+        _loop_in_data( st, n );
+      } else if ( 0 == n ) {
+        _loop_in_eof( st );
+      } else if ( (EAGAIN != errno) && (EINTR != errno) ) {
+        err_msg( "Failed reading from FD=%i", cfg->fd_in );
+        st->in_open = 0;
+        st->retval = -1;
+      }
+
+      // Try right away, the device is writable most of the time:
+      if ( st->npend > 0 ) {
+        _loop_dev_write( st );
+        if ( 0 == st->npend )
+          iobuf_adapt( &st->in, st->nraw );
+      }
+    }
+  }
+
+  if ( 0 <= wflags )
+    fcntl( cfg->fd_dev_write, F_SETFL, wflags );
+
+  close( set.ep );
 }
 
 
-// Take care of the linefeed and null-termination of a string:
-void loop_duplex_stdio( int fd_read, int fd_write, int ieof, int translate,
-                        size_t bufsize, int nolf, char *linefeed )
+#if defined( PTY_HAVE_IO_URING )
+
+#define URING_ENTRIES   ( 16 )
+#define URING_POLL      ( 0x100 )   // user_data flag of a poll ahead of an op
+
+/*!
+ * \brief   Operations of the io_uring engine, used as user_data. There is at
+ *          most one of each in flight.
+ */
+enum {
+  URING_IN_READ = 0,
+  URING_DEV_READ,
+  URING_DEV_WRITE,
+  URING_OUT_WRITE,
+  URING_SIGNAL,
+  URING_CHILD,
+  URING_OPS
+};
+
+#define URING_CANCEL    ( 0x200 )   // user_data flag of a cancel request
+
+
+/*!
+ * \brief   An io_uring instance, mapped without liburing.
+ */
+typedef struct {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *ring;
+  size_t ring_size;
+  size_t sqes_size;
+  unsigned entries;
+  unsigned tail;            // local SQ tail, published on enter
+  unsigned queued;          // SQEs not submitted yet
+  unsigned inflight;        // submitted SQEs without CQE
+} tUring;
+
+
+/*!
+ * \return  0 if o.k, -1 if io_uring is not available (kernel older than 5.6,
+ *          disabled by sysctl or seccomp).
+ */
+static int _uring_init( tUring *u, unsigned entries )
 {
-  pid_t pid = -1;    // distinguish parrent/child process
-  int nread, nwrite = 0;
-  size_t lfsize = 0;
+  struct io_uring_params p;
+  char *ring;
 
-  if ( NULL != linefeed )
-    lfsize = strlen( linefeed );
+  memset( &p, 0, sizeof( p ) );
 
-  lds_tbuf = NULL;   // pointer to read/write buffer
-  lds_buffer = NULL; // pointer to translation buffer
+  if ( 0 > (u->fd = (int)syscall( __NR_io_uring_setup, entries, &p )) )
+    return ( -1 );
 
-  // Reserve space for read/write buffer:
-  if ( NULL == (lds_buffer = malloc( bufsize )) )
-    err_sys( "Not enough space for read/write buffers" );
+  // One mapping for both rings, reads and writes at the file position:
+  if ( (0 == (p.features & IORING_FEAT_SINGLE_MMAP)) ||
+       (0 == (p.features & IORING_FEAT_RW_CUR_POS)) )
+    goto uring_init_close;
+
+  u->ring_size = p.sq_off.array + p.sq_entries*sizeof( unsigned );
+  if ( u->ring_size < p.cq_off.cqes + p.cq_entries*sizeof( struct io_uring_cqe ) )
+    u->ring_size = p.cq_off.cqes + p.cq_entries*sizeof( struct io_uring_cqe );
+
+  u->ring = mmap( NULL, u->ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING );
+  if ( MAP_FAILED == u->ring )
+    goto uring_init_close;
+
+  u->sqes_size = p.sq_entries*sizeof( struct io_uring_sqe );
+  u->sqes = (struct io_uring_sqe*)mmap( NULL, u->sqes_size,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, u->fd,
+                                        IORING_OFF_SQES );
+  if ( MAP_FAILED == u->sqes )
+    goto uring_init_unmap;
+
+  ring = (char*)u->ring;
+  u->sq_head  = (unsigned*)(ring + p.sq_off.head);
+  u->sq_tail  = (unsigned*)(ring + p.sq_off.tail);
+  u->sq_mask  = (unsigned*)(ring + p.sq_off.ring_mask);
+  u->sq_array = (unsigned*)(ring + p.sq_off.array);
+  u->cq_head  = (unsigned*)(ring + p.cq_off.head);
+  u->cq_tail  = (unsigned*)(ring + p.cq_off.tail);
+  u->cq_mask  = (unsigned*)(ring + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe*)(ring + p.cq_off.cqes);
+
+  u->entries = p.sq_entries;
+  u->tail = *u->sq_tail;
+  u->queued = u->inflight = 0;
+
+  return ( 0 );
+
+uring_init_unmap:
+  munmap( u->ring, u->ring_size );
+uring_init_close:
+  close( u->fd );
+  return ( -1 );
+}
+
+
+static void _uring_exit( tUring *u )
+{
+  munmap( u->sqes, u->sqes_size );
+  munmap( u->ring, u->ring_size );
+  close( u->fd );
+}
+
+
+static struct io_uring_sqe *_uring_sqe( tUring *u, int op, int fd,
+                                        uint64_t user_data )
+{
+  struct io_uring_sqe *sqe;
+  unsigned idx;
+
+  if ( u->tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE ) >= u->entries )
+    err_quit( "io_uring submission queue overrun" ); // never more than URING_OPS
+
+  idx = u->tail & *u->sq_mask;
+  sqe = &u->sqes[idx];
+  memset( sqe, 0, sizeof( *sqe ) );
+  sqe->opcode = (uint8_t)op;
+  sqe->fd = fd;
+  sqe->user_data = user_data;
+  u->sq_array[idx] = idx;
+
+  u->tail++;
+  u->queued++;
+  u->inflight++;
+
+  return ( sqe );
+}
+
+
+/*!
+ * \brief   Submit all queued SQEs and wait for min_complete CQEs, with one
+ *          system call.
+ */
+static int _uring_enter( tUring *u, unsigned min_complete )
+{
+  int ret;
+
+  __atomic_store_n( u->sq_tail, u->tail, __ATOMIC_RELEASE );
+
+  do {
+    ret = (int)syscall( __NR_io_uring_enter, u->fd, u->queued, min_complete,
+                        (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0,
+                        NULL, 0 );
+  } while ( (0 > ret) && (EINTR == errno) );
+
+  if ( ret > 0 )
+    u->queued -= (unsigned)ret;
+
+  return ( ret );
+}
+
+
+static int _uring_cqe( tUring *u, struct io_uring_cqe *cqe )
+{
+  unsigned head = *u->cq_head;
+
+  if ( head == __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE ) )
+    return ( 0 );
+
+  *cqe = u->cqes[head & *u->cq_mask];
+  __atomic_store_n( u->cq_head, head + 1, __ATOMIC_RELEASE );
+  u->inflight--;
+
+  return ( 1 );
+}
+
+
+typedef struct {
+  tUring u;
+  int fixed;                // buffers registered
+  int busy[URING_OPS];      // op in flight
+  int cancel[URING_OPS];    // cancel requested
+  int again[URING_OPS];     // descriptor is non-blocking, poll first
+  struct signalfd_siginfo si;
+} tLoop_uring;
 
-  fflush( stdin );
-  fflush( stdout );
 
-  // fd_read == -1 demands just echoing back STDIN to STDOUT:
-  if ( -1 != fd_read ) {
-    if ( (pid = fork()) < 0 )
-      err_sys( "Failed forking into read/write loop" );
+static void _uring_poll( tLoop_uring *lu, int fd, uint32_t events,
+                         uint64_t user_data, int link )
+{
+  struct io_uring_sqe *sqe;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  events = (events << 16) | (events >> 16); // word-reversed
+#endif
+
+  sqe = _uring_sqe( &lu->u, IORING_OP_POLL_ADD, fd, user_data );
+  sqe->poll32_events = events;
+  if ( 1 == link )
+    sqe->flags |= IOSQE_IO_LINK;
+}
+
+
+static void _uring_cancel( tLoop_uring *lu, int tag )
+{
+  _uring_sqe( &lu->u, IORING_OP_ASYNC_CANCEL, -1, URING_CANCEL | tag )->addr =
+    (uint64_t)tag;
+  if ( 1 == lu->again[tag] )
+    _uring_sqe( &lu->u, IORING_OP_ASYNC_CANCEL, -1,
+                URING_CANCEL | URING_POLL | tag )->addr = URING_POLL | tag;
+
+  lu->cancel[tag] = 1;
+}
+
+
+/*!
+ * \brief   Queue a read or write. A non-blocking descriptor answers EAGAIN
+ *          instead of waiting, so a poll is linked ahead of it then.
+ * \param   [IN]  link        Link the next queued operation behind this one,
+ *                            it starts when this one has succeeded in full.
+ */
+static void _uring_rw( tLoop_uring *lu, int tag, int op, int fd, void *addr,
+                       unsigned len, int buf_index, int link )
+{
+  struct io_uring_sqe *sqe;
+
+  if ( 1 == lu->again[tag] )
+    _uring_poll( lu, fd, (IORING_OP_WRITEV == op) ? POLLOUT : POLLIN,
+                 URING_POLL | tag, 1 );
+
+  sqe = _uring_sqe( &lu->u, op, fd, tag );
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->off = (uint64_t)-1; // current file position
+  if ( 0 <= buf_index )
+    sqe->buf_index = (uint16_t)buf_index;
+  if ( 1 == link )
+    sqe->flags |= IOSQE_IO_LINK;
+
+  lu->busy[tag] = 1;
+}
+
+
+static void _uring_read( tLoop_uring *lu, int tag, int fd, tIobuf *ib,
+                         int buf_index )
+{
+  if ( 1 == lu->fixed )
+    _uring_rw( lu, tag, IORING_OP_READ_FIXED, fd, ib->buf, (unsigned)ib->size,
+               buf_index, 0 );
+  else
+    _uring_rw( lu, tag, IORING_OP_READ, fd, ib->buf, (unsigned)ib->size, -1,
+               0 );
+}
+
+
+/*!
+ * \brief   Queue all operations the state asks for. A write of a read buffer
+ *          gets the next read into that buffer linked behind it, so a busy
+ *          session needs one io_uring_enter() per chunk.
+ */
+static void _uring_queue( tLoop_uring *lu, tLoop_state *st )
+{
+  const tPty_loop *cfg = st->cfg;
+  int link;
+
+  if ( (st->npend > 0) && (0 == lu->busy[URING_DEV_WRITE]) ) {
+    link = ((1 == st->in_open) && (0 == lu->busy[URING_IN_READ])) ? 1 : 0;
+    _uring_rw( lu, URING_DEV_WRITE, IORING_OP_WRITEV, cfg->fd_dev_write,
+               st->pend, (unsigned)st->npend, -1, link );
+    if ( 1 == link )
+      _uring_read( lu, URING_IN_READ, cfg->fd_in, &st->in, 0 );
   }
 
-  if ( 0 == pid ) {
-    /////////////////////////////
-    // Inside child or no-fork //
-    /////////////////////////////
+  if ( (1 == st->in_open) && (0 == st->npend) &&
+       (0 == lu->busy[URING_IN_READ]) )
+    _uring_read( lu, URING_IN_READ, cfg->fd_in, &st->in, 0 );
 
-    // Close master channel:
-    close( fd_write );
-    close( STDIN_FILENO );
+  if ( (st->nout > 0) && (0 == lu->busy[URING_OUT_WRITE]) ) {
+    link = ((1 == st->dev_open) && (0 == lu->busy[URING_DEV_READ])) ? 1 : 0;
+    _uring_rw( lu, URING_OUT_WRITE, IORING_OP_WRITEV, cfg->fd_out, st->out,
+               (unsigned)st->nout, -1, link );
+    if ( 1 == link )
+      _uring_read( lu, URING_DEV_READ, cfg->fd_dev_read, &st->dev, 1 );
+  }
 
-    if ( 1 == translate ) {
-      // Reserve space for translation buffer (is twice as big a buf size):
-      if ( NULL == (lds_tbuf = malloc( bufsize*2 )) )
-        err_sys( "Not enough space for translation buffer" ); 
-    }
+  if ( (1 == st->dev_open) && (0 == st->nout) &&
+       (0 == lu->busy[URING_DEV_READ]) )
+    _uring_read( lu, URING_DEV_READ, cfg->fd_dev_read, &st->dev, 1 );
 
-    while ( (-1 < nwrite) && (-1 < nread) ) {
-      // Read from device and write to STDOUT:
-      if ( 0 < (nread = read( fd_read, lds_buffer, bufsize )) ) {
-        //if (1 == nolf)
-        //  nread -= 1;
+  if ( 0 == lu->busy[URING_SIGNAL] )
+    _uring_rw( lu, URING_SIGNAL, IORING_OP_READ, st->sfd, &lu->si,
+               sizeof( lu->si ), -1, 0 );
 
-        if ( 1 == translate ) {
-          _bflush( lds_tbuf, nread*2, &ascii_null );
+  if ( (0 <= st->pfd) && (0 == lu->busy[URING_CHILD]) ) {
+    _uring_poll( lu, st->pfd, POLLIN, URING_CHILD, 0 );
+    lu->busy[URING_CHILD] = 1;
+  }
+}
 
-          // HEX to ASCII:
-          nwrite = u8nprints( (char*)lds_tbuf, ((size_t)nread)*2, \
-                              (uint8_t*)lds_buffer, (size_t)nread );
 
-          nwrite = write_or_warn( STDOUT_FILENO, lds_tbuf, nwrite );
-        } else {
-          nwrite = write_or_warn( STDOUT_FILENO, lds_buffer, nread );
-        }
+/*!
+ * \brief   Apply a completion to the state. A read cancelled because the
+ *          write ahead of it was short is queued again by _uring_queue().
+ */
+static void _uring_complete( tLoop_uring *lu, tLoop_state *st,
+                             const struct io_uring_cqe *cqe )
+{
+  const tPty_loop *cfg = st->cfg;
+  int tag = (int)cqe->user_data;
+  int res = cqe->res;
+
+  if ( URING_CANCEL == (tag & (URING_CANCEL | URING_POLL)) ) {
+    if ( -ENOENT == res )
+      lu->cancel[tag & ~URING_CANCEL] = 0; // not issued yet, try again
+    return;
+  }
 
-        if ( NULL != linefeed )
-          write_or_warn( STDOUT_FILENO, &linefeed, lfsize );
-      } else if ( 0 == ieof ) {
-        break;
+  if ( URING_POLL & tag )
+    return; // the operation behind tells
+
+  lu->busy[tag] = lu->cancel[tag] = 0;
+
+  if ( (-ECANCELED == res) || (-EINTR == res) )
+    return;
+
+  if ( -EAGAIN == res ) {
+    lu->again[tag] = 1;
+    return;
+  }
+
+  switch ( tag ) {
+    case URING_IN_READ:
+      if ( res > 0 ) {
+        _loop_in_data( st, res );
+      } else if ( 0 == res ) {
+        _loop_in_eof( st );
+      } else {
+        errno = -res;
+        err_msg( "Failed reading from FD=%i", cfg->fd_in );
+        st->in_open = 0;
+        st->retval = -1;
+      }
+      break;
+
+    case URING_DEV_WRITE:
+      if ( res >= 0 ) {
+        _iov_consume( &st->pend, &st->npend, (size_t)res );
+      } else {
+        errno = -res;
+        err_msg( "Write failure (FD=%i) ", cfg->fd_dev_write );
+        _loop_stop( st );
+        st->retval = -1;
+      }
+      break;
+
+    case URING_DEV_READ:
+      if ( res > 0 ) {
+        _loop_dev_data( st, res );
+      } else if ( (0 == res) || (-EIO == res) ) { // EIO: PTY slave closed
+        if ( (0 != res) ||
+             (0 == _loop_keep_after_eof( cfg->fd_dev_read, cfg->ignore_eof )) )
+          _loop_stop( st );
+      } else {
+        errno = -res;
+        err_msg( "Read failure on device FD=%i", cfg->fd_dev_read );
+        _loop_stop( st );
+        st->retval = -1;
+      }
+      break;
+
+    case URING_OUT_WRITE:
+      if ( res < 0 ) {
+        errno = -res;
+        err_sys( "Write failure (FD=%i) ", cfg->fd_out );
+      }
+      _iov_consume( &st->out, &st->nout, (size_t)res );
+      break;
+
+    case URING_SIGNAL:
+      if ( sizeof( lu->si ) == res )
+        _loop_signal( st, &lu->si );
+      break;
+
+    case URING_CHILD:
+      if ( res > 0 )
+        st->exited = 1;
+      break;
+  }
+}
+
+
+/*!
+ * \brief   Completion based engine of pty_loop(): Reads and writes of both
+ *          directions are submitted and reaped in batches, with one system
+ *          call per round. The read buffers are registered with the kernel
+ *          (fixed buffers) at their full size.
+ * \return  0 if done, -1 if io_uring is not available here.
+ */
+static int _loop_uring( tLoop_state *st )
+{
+  tLoop_uring lu;
+  struct io_uring_cqe cqe;
+  struct iovec bufs[2];
+  tIobuf *ib[2];
+  void *p;
+  int i, tag;
+
+  memset( &lu, 0, sizeof( lu ) );
+
+  if ( 0 > _uring_init( &lu.u, URING_ENTRIES ) )
+    return ( -1 );
+
+  /*!
+   * \note    Registered buffers cannot move, so they stay at the size limit
+   *          instead of adapting (tIobuf).
+   */
+  ib[0] = &st->in;
+  ib[1] = &st->dev;
+
+  for ( i=0; i<2; i++ ) {
+    if ( NULL == ib[i]->buf ) {
+      // Direction not used, register a stub:
+      bufs[i].iov_base = &lu.si;
+      bufs[i].iov_len = sizeof( lu.si );
+      continue;
+    }
+
+    if ( ib[i]->size < ib[i]->cap ) {
+      if ( NULL != (p = realloc( ib[i]->buf, ib[i]->cap )) ) {
+        ib[i]->buf = (char*)p;
+        ib[i]->size = ib[i]->min = ib[i]->cap;
       }
     }
 
-    /*!
-     * \note    We always terminate, when we encounter an EOF on stdio (hang-
-     *          up sequence), but we notify the parent only when ignoreeof was
-     *          set.
-     */
-    if ( 1 == ieof )
-      // Child notifies parent:
-      kill( getppid(), SIGTERM );
+    bufs[i].iov_base = ib[i]->buf;
+    bufs[i].iov_len = ib[i]->size;
+  }
+
+  if ( 0 == syscall( __NR_io_uring_register, lu.u.fd, IORING_REGISTER_BUFFERS,
+                     bufs, 2 ) )
+    lu.fixed = 1; // else plain reads, e.g. RLIMIT_MEMLOCK exceeded
 
-    if ( 0 < nread )
-      err_sys( "Read failure on device FD=%i", fd_read );
+  lu.again[URING_SIGNAL] = 1; // signalfd is non-blocking
 
-    exit( 0 ); // child cannot return, but we do, if not forked
+  // A raw terminal with VMIN 0 answers a read right away, with nothing:
+  if ( (1 == st->in_open) && (1 == isatty( st->cfg->fd_in )) )
+    lu.again[URING_IN_READ] = 1;
+  if ( (1 == st->dev_open) && (1 == isatty( st->cfg->fd_dev_read )) )
+    lu.again[URING_DEV_READ] = 1;
+
+  while ( ((1 == st->in_open) || (st->npend > 0) || (1 == st->dev_open) ||
+           (st->nout > 0)) && (0 == st->exited) ) {
+    _uring_queue( &lu, st );
+
+    if ( 0 > _uring_enter( &lu.u, 1 ) )
+      err_sys( "io_uring failure" );
+
+    while ( 1 == _uring_cqe( &lu.u, &cqe ) )
+      _uring_complete( &lu, st, &cqe );
   }
 
-  ////////////////////////////
-  // Inside parent process: //
-  ////////////////////////////
+  /*!
+   * \brief   No operation may be left in flight on the buffers. After the
+   *          child has ended, its output still on the way to fd_out is
+   *          written out.
+   */
+  while ( lu.u.inflight > 0 ) {
+    for ( tag=0; tag<URING_OPS; tag++ ) {
+      if ( (0 == lu.busy[tag]) || (1 == lu.cancel[tag]) )
+        continue;
+
+      // The childs last output and the read linked behind it:
+      if ( (0 != st->exited) && (1 == lu.busy[URING_OUT_WRITE]) &&
+           ((URING_OUT_WRITE == tag) || (URING_DEV_READ == tag)) )
+        continue;
+
+      _uring_cancel( &lu, tag );
+    }
+
+    if ( 0 > _uring_enter( &lu.u, 1 ) )
+      err_sys( "io_uring failure" );
 
-  // Close slave channel:
-  if ( -1 < fd_read ) {
-    close( fd_read ); // close only if given (not in echo-mode)
-    close( STDOUT_FILENO );
+    while ( 1 == _uring_cqe( &lu.u, &cqe ) )
+      _uring_complete( &lu, st, &cqe );
   }
 
-  if ( 1 == translate ) {
-    // HEX buffer is half the size of ASCII buffer:
-    if ( NULL == (lds_tbuf = malloc( bufsize/2 + 1 )) )
-      err_sys( "Not enough space for translation buffer" ); 
+  if ( (0 != st->exited) && (st->nout > 0) ) {
+    if ( 0 > full_writev( st->cfg->fd_out, st->out, st->nout ) )
+      err_sys( "Write failure (FD=%i) ", st->cfg->fd_out );
   }
+  st->nout = 0;
 
-  if ( SIG_ERR == signal_intr( SIGTERM, sig_term ) )
-    err_sys( "Cannot install signal handler for SIGTERM" );
+  _uring_exit( &lu.u );
 
-  while ( (-1 < nwrite) && (-1 < nread) ) {
-    // Read from STDIN and write to device:
-    if ( 0 < (nread = read( STDIN_FILENO, lds_buffer, bufsize )) ) {
-      if (1 == nolf)
-        nread -= 1;
+  return ( 0 );
+}
 
-      if ( 1 == translate ) {
-        _bflush( lds_tbuf, nread/2 + 1, &ascii_null );
+#endif // PTY_HAVE_IO_URING
 
-        // ASCII to HEX:
-        nwrite = snprintu8( (uint8_t*)lds_tbuf, ((size_t)nread)/2 + \
-                            ((size_t)nread)%2,
-                            (char*)lds_buffer, (size_t)nread );
 
-        nwrite = write_or_warn( fd_write, lds_tbuf, nwrite );
+int pty_loop( const tPty_loop *cfg )
+{
+  tLoop_state st;
+  sigset_t mask, omask;
+  const char *env;
+  int engine = cfg->engine;
 
-      } else {
-        nwrite = write_or_warn( fd_write, lds_buffer, nread );
-      }
-      if ( NULL != linefeed ) // guarded non-exclusively before
-        //write_or_warn( STDOUT_FILENO, &linefeed, 1 );
-        write_or_warn( fd_write, &linefeed, lfsize );
+  memset( &st, 0, sizeof( st ) );
+  st.cfg = cfg;
+  st.rec = cfg->rec;
+  st.sfd = st.pfd = -1;
+  st.in_open = (0 <= cfg->fd_in) ? 1 : 0;
+  st.dev_open = (0 <= cfg->fd_dev_read) ? 1 : 0;
+
+  if ( NULL != cfg->linefeed )
+    st.lfsize = strlen( cfg->linefeed );
+
+  hex_decoder_init( &st.dec, 0, 0 );
+
+  if ( (1 == st.in_open) &&
+       (0 > iobuf_init( &st.in, cfg->fd_in, cfg->bufsize, 1 )) )
+    err_sys( "Not enough space for read/write buffers" );
+  if ( (1 == st.dev_open) &&
+       (0 > iobuf_init( &st.dev, cfg->fd_dev_read, cfg->bufsize, 1 )) )
+    err_sys( "Not enough space for read/write buffers" );
+
+  /*!
+   * \brief   Signals are read from a descriptor like the data, so there is no
+   *          handler racing with the loop. Without pidfd (Linux < 5.3) the
+   *          child is waited for on SIGCHLD.
+   */
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGINT );
+  sigaddset( &mask, SIGTERM );
+  sigaddset( &mask, SIGHUP );
+
+  if ( cfg->child > 0 ) {
+  #if defined( SYS_pidfd_open )
+    st.pfd = (int)syscall( SYS_pidfd_open, cfg->child, 0 );
+  #endif
+    if ( st.pfd < 0 )
+      sigaddset( &mask, SIGCHLD );
+  }
+
+  if ( 0 > sigprocmask( SIG_BLOCK, &mask, &omask ) )
+    err_sys( "Cannot block signals for the event loop" );
+
+  if ( 0 > (st.sfd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC )) )
+    err_sys( "Cannot create signal descriptor" );
+
+  if ( (PTY_LOOP_AUTO == engine) && (NULL != (env = getenv( PTY_LOOP_ENV ))) &&
+       (0 == strcmp( env, "epoll" )) )
+    engine = PTY_LOOP_EPOLL;
+
+  // Pacing needs a timer between the writes, the epoll engine has it:
+#if defined( PTY_HAVE_IO_URING )
+  if ( (PTY_LOOP_EPOLL == engine) || (NULL != cfg->pace) ||
+       (0 > _loop_uring( &st )) )
+#endif
+    _loop_epoll( &st );
+
+  /*!
+   * \brief   The child has ended: Its last output may still wait in the
+   *          device, then reap it.
+   */
+  if ( 0 != st.exited ) {
+    if ( 1 == st.dev_open ) {
+      fcntl( cfg->fd_dev_read, F_SETFL,
+             fcntl( cfg->fd_dev_read, F_GETFL ) | O_NONBLOCK );
+      while ( 0 < _loop_dev_to_out( &st ) )
+        ;
     }
+
+    if ( (1 == st.exited) && (0 > waitpid( cfg->child, &st.status, 0 )) )
+      err_msg( "Cannot reap child PID=%i", (int)cfg->child );
+
+    if ( WIFEXITED( st.status ) )
+      st.retval = WEXITSTATUS( st.status );
+    else if ( WIFSIGNALED( st.status ) )
+      st.retval = 128 + WTERMSIG( st.status );
+  } else if ( cfg->child > 0 ) {
+    st.retval = -1; // child still running
   }
 
-  if ( 0 < nread )
-    err_msg( "Failed reading from stdin" );
+  close( st.sfd );
+  if ( 0 <= st.pfd )
+    close( st.pfd );
 
-  // Make it bullet-proof:
-  if ( NULL != lds_tbuf )
-    free( lds_tbuf );
-  lds_tbuf = NULL;
+  if ( (NULL != st.rec) && (0 > rec_flush( st.rec )) )
+    err_msg( "Cannot write the recording" );
 
-  if ( NULL != lds_buffer )
-    free( lds_buffer );
-  lds_tbuf = NULL;
- 
-  // Signal caught, error occured or EOF detected, parent returns to caller.
+  sigprocmask( SIG_SETMASK, &omask, NULL );
+
+  if ( 0 <= cfg->fd_in )
+    iobuf_free( &st.in );
+  if ( 0 <= cfg->fd_dev_read )
+    iobuf_free( &st.dev );
+  free( st.tbuf );
+
+  return ( st.retval );
+}
+
+
+void loop_duplex_stdio( int fd_read, int fd_write, int ieof, int translate,
+                        size_t bufsize, int nolf, char *linefeed,
+                        tPace *pace )
+{
+  tPty_loop lp;
+
+  fflush( stdout );
+
+  lp.fd_in = STDIN_FILENO;
+  lp.fd_out = STDOUT_FILENO;
+  lp.fd_dev_read = fd_read;   // -1: echo STDIN to fd_write
+  lp.fd_dev_write = fd_write;
+  lp.child = 0;
+  lp.ignore_eof = ieof;
+  lp.translate = translate;
+  lp.nolf = nolf;
+  lp.linefeed = linefeed;
+  lp.bufsize = bufsize;
+  lp.engine = PTY_LOOP_AUTO;
+  lp.escape = -1;
+  lp.rec = NULL;
+  lp.pace = pace;
+
+  pty_loop( &lp );
+
+  // Signal caught, error occured or EOF detected, return to caller.
 }
 
 
@@ -38,6 +38,26 @@
  * \date     2020-05-30   Fixed loop_duplex_stdio() linefeed settings for option
  *                        'nolf' ignoring CR/NL on STDIN.
  *                        Added window-size settings and restore.                 
+ * \date     2026-10-15   SIMD (SSE2/AVX2) HEX codec kernels behind snprintu8()
+ *                        and u8nprints(), selected at startup.
+ *                        Scalar translation uses the constexpr tables of
+ *                        hex.h instead of searching the nibble-char table.
+ *                        Streaming HEX decoder (hex_decode_stream()) keeping
+ *                        a lone nibble across read() boundaries.
+ *                        Adaptive read buffers (tIobuf) for the pump loops.
+ *                        Formatted hexdump (hexdump_line()), hcat() option.
+ *                        Single-process epoll loop (pty_loop()) replaces the
+ *                        forked pumps of loop_duplex_stdio().
+ *                        io_uring engine for pty_loop(), epoll as fallback.
+ *                        Escape character for pty_loop() (session detach).
+ *                        Session recording (tRecord) in pty_loop().
+ *                        Reader of recordings (rec_read()).
+ * \date     2026-10-16   Transmit pacing (tPace, pace.h) of the device writes
+ *                        in pty_loop() and loop_duplex_stdio().
+ *                        Reads with a deadline (pty_read_exact(),
+ *                        pty_read_until()).
+ *                        nonblock_immune_read(), full_write() and
+ *                        full_writev() wait with poll() on EAGAIN.
  *
  * \note
  *           The source code of this library is intended to for implementations
@@ -96,6 +116,9 @@
                               // exit(), [atexit() >> main.c]
 #include <string.h>           // strncpy(), malloc()
 #include <unistd.h>           // read(), write(), opterr
+#include <time.h>             // struct timespec
+#include <sys/uio.h>          // writev(), struct iovec
+#include <stdint.h>           // uint64_t
 
 #if defined( SOLARIS )
   #include <stropts.h>
@@ -104,6 +127,8 @@
 #include <fcntl.h>            // posix_openpt(), open() O_FLAGS
 #include <termios.h>          // termios, tcgetattr(), tcsetattr(), ttyname()
 
+#include "pace.h"             // tPace
+
 #ifndef TIOCGWINSZ
   #include <sys/ioctl.h>
 #else
@@ -208,7 +233,6 @@ Sigfunc *signal_intr( int signo, Sigfunc *func );
  * \brief   This function should be called when using one of the folling
  *          functions that reserve dynamic allocated space:
  *          *      hcat()
- *          *      loop_duplex_stdio()
  *          This is to prevent memory leaks by installing an exit-handler, that
  *          releases the reserved address areas on program termination. You also
  *          should use it in conjunction with:
@@ -256,7 +280,8 @@ ssize_t write_or_warn( int fd, const void *buf, size_t len );
 /*!
  * \brief    Writes to file associated to filedescriptor fd. In case of using
  *           larget file to write to, this function use subsequent write-cycles
- *           till all data is written.
+ *           till all data is written. If fd is in O_NONBLOCK mode (set by a
+ *           child sharing it), it waits with poll() for room and resumes.
  * \param    [IN]  fd          Filedescriptor to target file.
  * \param    [IN]  *buf        Source address of data.
  * \param    [IN]  len         Number of bytes to transfer.
@@ -265,6 +290,29 @@ ssize_t write_or_warn( int fd, const void *buf, size_t len );
 ssize_t full_write( int fd, const void *buf, size_t len );
 
 
+/*!
+ * \brief    full_write(), waiting for a slow reader until a deadline at most.
+ * \param    [IN]  deadline_ns CLOCK_MONOTONIC [ns] (pty_deadline()), 0 for
+ *                             none.
+ * \return   Number of bytes written, fewer than len at the deadline (errno
+ *           ETIMEDOUT). -1 on error before any byte was written.
+ */
+ssize_t full_write_deadline( int fd, const void *buf, size_t len,
+                             uint64_t deadline_ns );
+
+
+/*!
+ * \brief    Gather write of several buffers in as few writev() calls as
+ *           possible, usually one. A partial write is resumed where it stopped.
+ * \param    [IN]  fd          Filedescriptor to target file.
+ * \param    [IN]  *iov        Buffers to write. The array is used up while
+ *                             resuming partial writes (not const).
+ * \param    [IN]  iovcnt      Number of buffers.
+ * \return   On error, returns -1, number of bytes actually written otherwise.
+ */
+ssize_t full_writev( int fd, struct iovec *iov, int iovcnt );
+
+
 /*!
  * \brief  Erik Andersen says for the busybox nonblock_immune_read():
  *   "Suppose that you are a shell. You start child processes. They work and
@@ -304,7 +352,8 @@ ssize_t full_write( int fd, const void *buf, size_t len );
  * " [...]
  *
  * Erik does use a polling-structure that doesn't care about O_NONBLOCK flag,
- * so we do, just without the rest of the libbb.h.
+ * so we do, just without the rest of the libbb.h: On EAGAIN it waits with
+ * poll() for data, EINTR is retried.
  *
  * \param    [IN]  fd            The filedescriptor to read from.
  * \param    [IN]  *buf          Address of buffer to read to.
@@ -314,6 +363,233 @@ ssize_t full_write( int fd, const void *buf, size_t len );
 ssize_t nonblock_immune_read( int fd, void *buf, size_t count );
 
 
+/*!
+ * \brief    nonblock_immune_read(), waiting for data until a deadline at most.
+ * \param    [IN]  deadline_ns   CLOCK_MONOTONIC [ns] (pty_deadline()), 0 for
+ *                               none.
+ * \return   The number of bytes read, -1 on error or at the deadline (errno
+ *           ETIMEDOUT).
+ */
+ssize_t nonblock_immune_read_deadline( int fd, void *buf, size_t count,
+                                       uint64_t deadline_ns );
+
+
+/*!
+ * \brief    Absolute deadline for pty_read_exact() and pty_read_until().
+ * \param    [IN]  timeout_ms    Time from now [ms].
+ * \return   CLOCK_MONOTONIC [ns].
+ */
+uint64_t pty_deadline( unsigned int timeout_ms );
+
+
+/*!
+ * \brief    Read exactly n bytes, e.g. a register block of a device, unless
+ *           the deadline passes first. Unlike VMIN (255 at most) and VTIME
+ *           (steps of 100 ms) of tty_raw_blocking() and tty_raw_timeout(),
+ *           it does not depend on the terminal settings: It waits with
+ *           ppoll() for the time left and reads all there is with each
+ *           read(), works on blocking and non-blocking descriptors alike.
+ * \param    [IN]  fd            The filedescriptor to read from.
+ * \param    [OUT] *buf          Address of buffer to read to.
+ * \param    [IN]  n             Number of bytes to read.
+ * \param    [IN]  deadline_ns   CLOCK_MONOTONIC [ns] (pty_deadline()), 0 for
+ *                               none.
+ * \return   Number of bytes read. Fewer than n if the deadline has passed
+ *           (errno ETIMEDOUT) or on EOF (errno 0). -1 on error before any
+ *           byte was read.
+ */
+ssize_t pty_read_exact( int fd, void *buf, size_t n, uint64_t deadline_ns );
+
+
+/*!
+ * \brief    Read until a read() brings one of the bytes of delim_set, cap is
+ *           full or the deadline passes, like pty_read_exact() does. Bytes
+ *           the same read() brought behind the delimiter are returned too, a
+ *           device answering a request usually sends nothing behind it.
+ * \param    [IN]  fd            The filedescriptor to read from.
+ * \param    [OUT] *buf          Address of buffer to read to.
+ * \param    [IN]  cap           Size of buf.
+ * \param    [IN]  *delim_set    Bytes ending the read, e.g. "\r\n".
+ * \param    [IN]  deadline_ns   CLOCK_MONOTONIC [ns] (pty_deadline()), 0 for
+ *                               none.
+ * \return   Number of bytes read. errno is 0 if a delimiter was read (or EOF),
+ *           ENOBUFS if cap bytes were read without a delimiter (read on with
+ *           more room), ETIMEDOUT if the deadline has passed without. -1 on
+ *           error before any byte was read.
+ */
+ssize_t pty_read_until( int fd, void *buf, size_t cap, const char *delim_set,
+                        uint64_t deadline_ns );
+
+
+/*!
+ * \brief    Read buffer adapting its size to the traffic: It doubles after
+ *           reads filled it up several times in a row (up to cap), halves after
+ *           a row of sparse reads and falls back to the start size after a
+ *           second of silence.
+ */
+typedef struct {
+  char *buf;                  // buffer of size bytes, NULL if not owned
+  size_t size;                // number of bytes to read next
+  size_t min;                 // start size, never shrinking below
+  size_t cap;                 // upper limit
+  int own;                    // 1: buf is allocated by iobuf_adapt()
+  unsigned full;              // reads filling the buffer in a row
+  unsigned sparse;            // reads using less than a quarter in a row
+  struct timespec last;       // time of the last read
+} tIobuf;
+
+#define IOBUF_DEFAULT_CAP ( 256*1024 )
+
+
+/*!
+ * \brief    Initialize an adaptive read buffer for fd. The start size is the
+ *           pipe capacity for pipes (Linux) or st_blksize otherwise.
+ * \param    [OUT] *ib           Buffer state.
+ * \param    [IN]  fd            File descriptor that is going to be read.
+ * \param    [IN]  cap           Upper size limit.
+ * \param    [IN]  alloc         1: allocate ib->buf and resize it on the go.
+ *                               0: only compute ib->size, the caller reads to
+ *                               storage of cap bytes.
+ * \return   0 on success, -1 if the buffer cannot be allocated.
+ */
+int iobuf_init( tIobuf *ib, int fd, size_t cap, int alloc );
+
+
+/*!
+ * \brief    Account a read() of nread bytes and resize for the next one. The
+ *           content of ib->buf is not preserved.
+ * \param    [IN]  *ib           Buffer state.
+ * \param    [IN]  nread         Result of the last read().
+ */
+void iobuf_adapt( tIobuf *ib, ssize_t nread );
+
+
+/*!
+ * \brief    Free the buffer allocated by iobuf_init().
+ */
+void iobuf_free( tIobuf *ib );
+
+
+/*!
+ * \brief    Session recording (pty -w). The file starts with REC_MAGIC, then
+ *           follows one record per read on either side of the PTY:
+ *
+ *             uint64_t  delta     [ns] since the record before (monotonic)
+ *             uint8_t   dir       REC_IN or REC_OUT
+ *             uint32_t  len       payload size
+ *             payload             bytes as they passed the PTY master
+ *
+ *           Integers are little endian. The file is only appended to, a new
+ *           recording continues an existing file. Records are collected in a
+ *           buffer of REC_BUFSIZE and written in batches.
+ */
+#define REC_MAGIC      "PTYREC1\n"
+#define REC_MAGIC_LEN  ( 8 )
+#define REC_HDR_LEN    ( 13 )
+#define REC_IN         ( 0 )            // to the program
+#define REC_OUT        ( 1 )            // from the program
+#define REC_BUFSIZE    ( 64*1024 )
+#define REC_IOV_MAX    ( 4 )
+
+typedef struct {
+  int fd;
+  uint64_t last;              // time of the last record [ns]
+  char *buf;                  // records not written yet
+  size_t len;
+} tRecord;
+
+
+/*!
+ * \brief    Open a recording file for appending (created with mode 0600).
+ *           A file not empty is appended to only if it is a recording.
+ * \return   0 if o.k, -1 on error (errno set). EINVAL if the file is not a
+ *           recording.
+ */
+int rec_open( tRecord *rec, const char *path );
+
+
+/*!
+ * \brief    Add a record of the gathered buffers. Nothing is recorded for an
+ *           empty payload.
+ * \param    [IN]  dir          REC_IN or REC_OUT.
+ * \param    [IN]  iovcnt       Number of buffers, up to REC_IOV_MAX.
+ * \return   0 if o.k, -1 on write error.
+ */
+int rec_writev( tRecord *rec, int dir, const struct iovec *iov, int iovcnt );
+
+
+/*!
+ * \brief    Write the buffered records to the file.
+ * \return   0 if o.k, -1 on write error.
+ */
+int rec_flush( tRecord *rec );
+
+
+/*!
+ * \brief    Flush and close the recording.
+ * \return   0 if o.k, -1 on write error.
+ */
+int rec_close( tRecord *rec );
+
+
+/*!
+ * \brief    Check the header of a recording file.
+ * \return   0 if fp is a recording, read up to the first record. -1 if not.
+ */
+int rec_check( FILE *fp );
+
+
+/*!
+ * \brief    Read the next record of a recording.
+ * \param    [OUT] *delta        [ns] since the record before.
+ * \param    [OUT] *dir          REC_IN or REC_OUT.
+ * \param    [IN/OUT] **buf      Payload buffer, grown with realloc().
+ * \param    [IN/OUT] *size      Size of *buf.
+ * \return   Payload size, 0 at the end of the recording, -1 on error (errno
+ *           EIO for a truncated record).
+ */
+ssize_t rec_read( FILE *fp, uint64_t *delta, int *dir, char **buf,
+                  size_t *size );
+
+
+#define HEXDUMP_MAX_COLS ( 256 )
+
+/*!
+ * \brief    Layout of a canonical hexdump line, e.g. with all features on:
+ *
+ *             00000010: 6c6c 6f20 776f 726c 640a            llo world.
+ */
+typedef struct {
+  size_t cols;          // bytes per line, 1..HEXDUMP_MAX_COLS
+  size_t group;         // bytes per group: 1, 2, 4 or 8
+  int swap;             // 1: groups are little endian words (LSB right)
+  int offset;           // 1: offset column
+  int ascii;            // 1: printable ASCII column, '.' for the others
+} tHexdump_fmt;
+
+
+/*!
+ * \brief    Number of characters a line of hexdump_line() takes at most,
+ *           including the linefeed.
+ */
+size_t hexdump_line_size( const tHexdump_fmt *fmt );
+
+
+/*!
+ * \brief    Render one hexdump line. Full lines are encoded by the HEX codec
+ *           kernel in one go and cut into groups afterwards.
+ * \param    [OUT] *out          Buffer of at least hexdump_line_size() chars.
+ * \param    [IN]  *in           Bytes of the line.
+ * \param    [IN]  n             Number of bytes, less than fmt->cols only for
+ *                               the last line (padded to align the columns).
+ * \param    [IN]  offset        Offset of in[0] in the dumped stream.
+ * \param    [IN]  *fmt          Line layout.
+ * \return   Number of characters written to *out (not '\0' terminated).
+ */
+size_t hexdump_line( char *out, const uint8_t *in, size_t n, uint64_t offset,
+                     const tHexdump_fmt *fmt );
+
+
 /*!
  * \brief    Concatenate several files to one resulting file.
  * \param    [OUT] fd_concat     The filedescriptor referring to target file.
@@ -322,14 +598,27 @@ ssize_t nonblock_immune_read( int fd, void *buf, size_t count );
  *                               translate to HEX byte representation on the
  *                               output data [0-9,A-F]. All other input data not
  *                               representing on of these HEX numbers are
- *                               translated to 0x00.
+ *                               translated to 0x00. Set to 2 to skip
+ *                               whitespace, linefeeds and "0x" prefixes
+ *                               instead (see hex_decoder_init()).
  * \param    [IN]  h2a           Translate input bytestream to ASCII on output.
+ * \param    [IN]  *dump         Print a formatted hexdump instead of plain
+ *                               HEX characters (see hexdump_line()). Offsets
+ *                               run on over all files. NULL: no hexdump.
  * \param    [IN]  verbose       Warn about opening a file that is not stdin.
  * \note     You can only translate from HEX to ASCII or vice versa. Anyhow, if
- *           a2h is set to 1, h2a is ignored.
+ *           a2h is set, h2a is ignored.
+ * \note     Pairs of HEX characters are formed over the whole file, not per
+ *           read(). A file with an odd number of characters gets a leading zero
+ *           nibble (like snprintu8()) if its size is known, otherwise the last
+ *           character becomes the last byte 0x0N.
+ * \note     Without translation the files are copied by the kernel where
+ *           possible (Linux). Regular files of 8 MiB and more translated to a
+ *           regular file are memory-mapped and translated by several threads.
  * \return   On success returns 0, otherwise 1.
  */
-int hcat( int fd_concat, char **argv, int a2h, int h2a, int verbose );
+int hcat( int fd_concat, char **argv, int a2h, int h2a,
+          const tHexdump_fmt *dump, int verbose );
 
 
 /*!
@@ -369,6 +658,77 @@ size_t snprintu8( uint8_t *out, size_t out_size, char *in, size_t in_size );
 size_t u8nprints( char *out, size_t out_size, uint8_t *in, size_t in_num );
 
 
+/*!
+ * \brief    Name of the HEX codec kernel snprintu8() and u8nprints() use. The
+ *           kernel is chosen once at program startup from the CPU features:
+ *           "avx2", "sse2" or the portable "scalar" one.
+ * \return   Kernel name (static string).
+ */
+const char *hex_kernel_name( void );
+
+
+/*!
+ * \brief    Measure the throughput of every HEX codec kernel the CPU supports
+ *           and print it in bytes/s of input to *stream.
+ * \param    [IN]  *stream       Where to print the report, e.g. stderr.
+ * \param    [IN]  len           Number of bytes to translate per round.
+ * \return   0 on success, -1 if the test buffers cannot be allocated.
+ */
+int hex_kernel_report( FILE *stream, size_t len );
+
+
+/*!
+ * \brief    State of a streaming ASCII to HEX translation. Unlike snprintu8()
+ *           a lone character at the end of one buffer is kept and paired with
+ *           the first character of the next one, so it does not matter where
+ *           read() splits the input.
+ */
+typedef struct {
+  int pending;          // high nibble waiting for its low nibble, -1: none
+  int pending_zero;     // pending nibble came from '0', may start "0x"
+  int skip_sep;         // skip whitespace, linefeeds and "0x" prefixes
+} tHex_decoder;
+
+
+/*!
+ * \brief    Initialize a streaming ASCII to HEX translation.
+ * \param    [OUT] *dec          Decoder state.
+ * \param    [IN]  skip_sep      1: skip whitespace (also '\n', '\r'), and
+ *                               "0x" or "0X" prefixes of bytes. 0: every
+ *                               character counts as a nibble, like snprintu8().
+ * \param    [IN]  lead_nibble   1: start with a pending zero nibble. Use it,
+ *                               when the input is known to have an odd number
+ *                               of characters, to get the leading zero of
+ *                               snprintu8() instead of a trailing one.
+ */
+void hex_decoder_init( tHex_decoder *dec, int skip_sep, int lead_nibble );
+
+
+/*!
+ * \brief    Translate the next piece of a HEX character stream to bytes.
+ *           Characters which are no HEX digit (and not skipped) are translated
+ *           to 0x00.
+ * \param    [IN]  *dec          Decoder state.
+ * \param    [OUT] *out          Byte buffer of at least (in_size + 1)/2 bytes.
+ *                               May be the same address as *in (in-place).
+ * \param    [IN]  *in           Input characters.
+ * \param    [IN]  in_size       Number of characters.
+ * \return   Number of bytes written to *out.
+ */
+size_t hex_decode_stream( tHex_decoder *dec, uint8_t *out, const char *in,
+                          size_t in_size );
+
+
+/*!
+ * \brief    End of the stream: A pending nibble is written as the low nibble of
+ *           a last byte (0x0N).
+ * \param    [IN]  *dec          Decoder state.
+ * \param    [OUT] *out          Buffer of at least one byte.
+ * \return   Number of bytes written to *out (0 or 1).
+ */
+size_t hex_decode_flush( tHex_decoder *dec, uint8_t *out );
+
+
 /*!
  * \brief    Interleaved string copy with marking character.
  * \param    [OUT] *dest         Destination string address.
@@ -397,12 +757,66 @@ char *stricpy( char *dest, const char *src, size_t n, const char div );
  *                               according HEX sequences.
  * \param    [IN]  andlf         Append LF when translating. Some applications
  *                               need a line termination to process data.
- * \param    [IN]  bufsize       Size of read/write buffers for data transfer.
+ * \param    [IN]  bufsize       Size limit of the read/write buffers. They
+ *                               start at the block size or pipe capacity of
+ *                               the input and adapt to the traffic (tIobuf).
  * \param    [IN]  nolf          Do not translate linefeed from read
- * \param    [IN]  *linefieed    Append linefeed at end of line.
+ * \param    [IN]  *linefieed    Append linefeed at end of line. Payload and
+ *                               linefeed go out with one writev().
+ * \param    [IN]  *pace         Transmit pacing of fd_write, NULL for none.
  */ 
 void loop_duplex_stdio( int fd_read, int fd_write, int ieof, int translate, 
-                        size_t bufsite, int nolf, char *linefeed );
+                        size_t bufsite, int nolf, char *linefeed,
+                        tPace *pace );
+
+
+/*!
+ * \brief    I/O engines of pty_loop(). PTY_LOOP_AUTO uses io_uring, if the
+ *           kernel provides it (Linux >= 5.6, not disabled), else epoll.
+ *           PTY_LOOP_ENGINE=epoll in the environment turns PTY_LOOP_AUTO into
+ *           PTY_LOOP_EPOLL, e.g. where io_uring misbehaves.
+ *           Compile with -DPTY_NO_IO_URING to leave io_uring out.
+ */
+#define PTY_LOOP_AUTO   ( 0 )
+#define PTY_LOOP_EPOLL  ( 1 )
+#define PTY_LOOP_ENV    "PTY_LOOP_ENGINE"
+
+
+/*!
+ * \brief    Configuration of pty_loop(). Unused descriptors are set to -1.
+ */
+typedef struct {
+  int fd_in;            // user input, e.g. STDIN
+  int fd_out;           // user output, e.g. STDOUT
+  int fd_dev_read;      // device to read from, -1 for input echo only
+  int fd_dev_write;     // device to write fd_in to, may equal fd_dev_read
+  pid_t child;          // process behind the device to reap, 0 if none
+  int ignore_eof;       // keep on reading terminals after EOF
+  int translate;        // ASCII to HEX from fd_in, HEX to ASCII to fd_out
+  int nolf;             // drop the last character of each fd_in read
+  const char *linefeed; // appended to each write, NULL for none
+  size_t bufsize;       // read buffer size limit (tIobuf)
+  int engine;           // PTY_LOOP_AUTO or PTY_LOOP_EPOLL
+  int escape;           // character on fd_in ending the loop, -1 for none
+  tRecord *rec;         // recording of the device I/O, NULL for none
+  tPace *pace;          // pacing of fd_dev_write, NULL for none (epoll)
+} tPty_loop;
+
+
+/*!
+ * \brief    Single-process event loop pumping both directions between the
+ *           user and a device (io_uring or epoll, see engine). With io_uring
+ *           the reads and writes are submitted in batches into registered
+ *           buffers. Writes to the device do not block:
+ *           Input is queued until the device takes it and fd_in is not read
+ *           meanwhile. SIGINT, SIGTERM and SIGHUP end the loop, they are
+ *           read by a signalfd. A child gets reaped through a pidfd (SIGCHLD
+ *           on kernels without), its remaining output is copied first.
+ * \param    [IN]  *cfg          Descriptors and translation settings.
+ * \return   Exit status of the child (128+signal if killed), 0 without
+ *           child, -1 on error or if the child still runs.
+ */
+int pty_loop( const tPty_loop *cfg );
 
                         
 /*!
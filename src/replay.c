@@ -0,0 +1,427 @@
+/* vi: set sw=4 ts=4: */
+
+/*
+ * Copyright (C) 2026
+ * Khoa Sebastian Nguyen
+ * <sebastian.nguyen@asog-central.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*!
+ * \note          Replay of a session recording (pty -w). The recorded output
+ *                is written to STDOUT with its original timing, scaled or at
+ *                full speed. With a program given, the recorded input is fed
+ *                to a fresh instance of it on a PTY instead, to reproduce the
+ *                session and to measure how fast the program responds.
+ *
+ *                Every record is due at the start time plus its recorded time
+ *                (scaled). Waiting for these absolute deadlines, with
+ *                clock_nanosleep() or a timerfd, does not accumulate drift.
+ */
+
+#include "pty.h"
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#define REPLAY_BUFSIZE      ( 64*1024 )
+#define NS_PER_SEC          ( 1000000000ULL )
+
+#ifdef LINUX
+  #define OPTSTR "+hms:t:v"
+#else
+  #define OPTSTR "hms:t:v"
+#endif
+
+
+const char *pname;
+FILE *fp;            // the recording
+char *payload;       // record buffer, grown by rec_read()
+size_t payload_size;
+
+
+void usage( const char *prog_name );
+
+
+/*!
+ * \brief   Minimum, maximum and average of measured times [ns].
+ */
+typedef struct {
+  unsigned long n;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+} tStat;
+
+
+static void stat_add( tStat *st, uint64_t v )
+{
+  if ( (0 == st->n) || (v < st->min) )
+    st->min = v;
+  if ( v > st->max )
+    st->max = v;
+
+  st->sum += v;
+  st->n++;
+}
+
+
+static void stat_print( const char *what, const tStat *st )
+{
+  if ( 0 == st->n ) {
+    fprintf( stderr, "%-12s none\n", what );
+    return;
+  }
+
+  fprintf( stderr, "%-12s n=%lu min=%.3f avg=%.3f max=%.3f ms\n", what,
+           st->n, (double)st->min/1e6, (double)st->sum/(double)st->n/1e6,
+           (double)st->max/1e6 );
+}
+
+
+static uint64_t now_ns( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( (uint64_t)ts.tv_sec*NS_PER_SEC + (uint64_t)ts.tv_nsec );
+}
+
+
+static void ns_to_ts( uint64_t ns, struct timespec *ts )
+{
+  ts->tv_sec = (time_t)(ns / NS_PER_SEC);
+  ts->tv_nsec = (long)(ns % NS_PER_SEC);
+}
+
+
+/*!
+ * \brief   Deadline of a record: Start plus its recorded time, scaled.
+ * \param   [IN]  speed       Factor, 2.0 is twice as fast.
+ */
+static uint64_t deadline( uint64_t t0, uint64_t rec_ns, double speed )
+{
+  return ( t0 + (uint64_t)((double)rec_ns / speed) );
+}
+
+
+static void cleanup( void )
+{
+  if ( NULL != fp )
+    fclose( fp );
+
+  free( payload );
+}
+
+
+/*!
+ * \brief   Write the recorded output to STDOUT, each record at its time.
+ * \param   [IN]  speed       Time scale, 0 for full speed.
+ * \param   [IN]  verbose     Report how late the records were written.
+ */
+static int replay_output( double speed, int verbose )
+{
+  struct timespec ts;
+  tStat late;
+  uint64_t t0, due, delta;
+  uint64_t total = 0;
+  ssize_t n;
+  int dir;
+
+  memset( &late, 0, sizeof( late ) );
+  t0 = now_ns();
+
+  while ( 0 < (n = rec_read( fp, &delta, &dir, &payload, &payload_size )) ) {
+    total += delta;
+    if ( REC_OUT != dir )
+      continue;
+
+    if ( speed > 0 ) {
+      due = deadline( t0, total, speed );
+      ns_to_ts( due, &ts );
+      while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                        NULL ) )
+        ;
+      stat_add( &late, now_ns() - due );
+    }
+
+    if ( 0 > full_write( STDOUT_FILENO, payload, (size_t)n ) )
+      err_sys( "Cannot write to STDOUT" );
+  }
+
+  if ( 0 > n )
+    err_sys( "Broken recording" );
+
+  if ( 1 == verbose )
+    stat_print( "Lateness:", &late );
+
+  return ( 0 );
+}
+
+
+static void timer_at( int tfd, uint64_t due )
+{
+  struct itimerspec its;
+
+  memset( &its, 0, sizeof( its ) );
+  ns_to_ts( due, &its.it_value );
+
+  if ( 0 > timerfd_settime( tfd, TFD_TIMER_ABSTIME, &its, NULL ) )
+    err_sys( "Cannot set the timer" );
+}
+
+
+/*!
+ * \brief   Start the program on a PTY and write the recorded input to it,
+ *          each record at its time. The output of the program is copied to
+ *          STDOUT. The response time is from an input written until the
+ *          first output after it.
+ * \param   [IN]  **argv      Program and its arguments.
+ * \param   [IN]  speed       Time scale, 0 for full speed.
+ * \param   [IN]  linger      [s] to run the program after the recording has
+ *                            ended, -1 until it ends by itself.
+ * \param   [IN]  verbose     Report how late the inputs were written.
+ * \return  Exit status of the program (128+signal if killed).
+ */
+static int replay_program( char **argv, double speed, double linger,
+                           int verbose )
+{
+  char obuf[REPLAY_BUFSIZE];
+  char pts[PTS_NAME_LENGTH];
+  struct pollfd pfd[2];
+  struct winsize ws, *wsp = NULL;
+  tStat late, resp;
+  uint64_t t0, due = 0, tw = 0, delta, expired;
+  uint64_t total = 0;
+  const char *pend = NULL;
+  size_t plen = 0, rlen = 0;
+  int waiting = 0;             // timer runs for the next input or the end
+  int expect = 0;              // input written, no response yet
+  int eof = 0;                 // no more input records
+  int fdm, tfd, dir, status = 0;
+  ssize_t n;
+  pid_t pid;
+
+  memset( &late, 0, sizeof( late ) );
+  memset( &resp, 0, sizeof( resp ) );
+
+  if ( (1 == isatty( STDOUT_FILENO )) &&
+       (0 == ioctl( STDOUT_FILENO, TIOCGWINSZ, &ws )) )
+    wsp = &ws;
+
+  if ( 0 > (pid = pty_fork_init( &fdm, pts, sizeof( pts ), wsp, 1 )) )
+    err_sys( "Cannot start the program on a PTY" );
+
+  if ( 0 == pid ) {
+    ///////////////////////////////
+    // Inside the child process: //
+    ///////////////////////////////
+    // Without echo the response is the programs own, not the line discipline:
+    tty_echo_disable( STDIN_FILENO );
+    execvp( argv[0], argv );
+    err_sys( "Execution error: %s", argv[0] );
+  }
+
+  ////////////////////////////////
+  // Inside the parent process: //
+  ////////////////////////////////
+  fcntl( fdm, F_SETFL, fcntl( fdm, F_GETFL ) | O_NONBLOCK );
+
+  if ( 0 > (tfd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC )) )
+    err_sys( "Cannot create a timer" );
+
+  t0 = now_ns();
+
+  for ( ;; ) {
+    // Next input record, output records only pass the time:
+    if ( (0 == eof) && (0 == waiting) && (0 == plen) ) {
+      while ( 0 < (n = rec_read( fp, &delta, &dir, &payload,
+                                 &payload_size )) ) {
+        total += delta;
+        if ( REC_IN == dir )
+          break;
+      }
+
+      if ( 0 > n )
+        err_sys( "Broken recording" );
+
+      if ( 0 == n ) {
+        eof = 1;
+        if ( linger >= 0 ) {
+          timer_at( tfd, now_ns() + (uint64_t)(linger * (double)NS_PER_SEC) );
+          waiting = 1;
+        }
+      } else if ( speed > 0 ) {
+        rlen = (size_t)n;
+        due = deadline( t0, total, speed );
+        timer_at( tfd, due );
+        waiting = 1;
+      } else {
+        pend = payload;
+        plen = (size_t)n;
+      }
+    }
+
+    // Input is written right away, poll() only when the PTY is full:
+    if ( plen > 0 ) {
+      if ( 0 < (n = write( fdm, pend, plen )) ) {
+        pend += n;
+        plen -= (size_t)n;
+        if ( 0 == plen ) {
+          tw = now_ns();
+          expect = 1;
+          continue;
+        }
+      } else if ( EAGAIN != errno ) {
+        break; // the program has ended
+      }
+    }
+
+    pfd[0].fd = fdm;
+    pfd[0].events = POLLIN | ((plen > 0) ? POLLOUT : 0);
+    pfd[1].fd = tfd;
+    pfd[1].events = (1 == waiting) ? POLLIN : 0;
+
+    if ( 0 > poll( pfd, 2, -1 ) ) {
+      if ( EINTR == errno )
+        continue;
+      err_sys( "Cannot wait for the program" );
+    }
+
+    if ( pfd[1].revents & POLLIN ) {
+      if ( 0 > read( tfd, &expired, sizeof( expired ) ) )
+        err_sys( "Cannot read the timer" );
+      waiting = 0;
+
+      if ( 1 == eof )
+        break; // the program had its time
+
+      stat_add( &late, now_ns() - due );
+      pend = payload;
+      plen = rlen;
+    }
+
+    if ( pfd[0].revents & (POLLIN | POLLHUP | POLLERR) ) {
+      if ( 0 < (n = read( fdm, obuf, sizeof( obuf ) )) ) {
+        if ( 1 == expect ) {
+          stat_add( &resp, now_ns() - tw );
+          expect = 0;
+        }
+        if ( 0 > full_write( STDOUT_FILENO, obuf, (size_t)n ) )
+          err_sys( "Cannot write to STDOUT" );
+      } else if ( (0 == n) || (EAGAIN != errno) ) {
+        break; // EIO: the program has ended
+      }
+    }
+  }
+
+  close( tfd );
+  close( fdm ); // hangs up on a program still running
+
+  if ( 0 > waitpid( pid, &status, 0 ) )
+    err_sys( "Cannot reap PID=%i", (int)pid );
+
+  stat_print( "Response:", &resp );
+  if ( (1 == verbose) && (speed > 0) )
+    stat_print( "Lateness:", &late );
+
+  if ( WIFSIGNALED( status ) )
+    return ( 128 + WTERMSIG( status ) );
+
+  return ( WEXITSTATUS( status ) );
+}
+
+
+int main( int argc, char *argv[] )
+{
+  double speed = 1.0;          // time scale, 0 for full speed
+  double linger = -1;          // [s] after the recording, -1 till the end
+  int verbose = 0;
+  int help = 0;
+  int c;
+
+  pname = argv[0];
+  fp = NULL;
+  payload = NULL;
+  payload_size = 0;
+  opterr = 0;
+
+  while ( EOF != (c = getopt( argc, argv, OPTSTR)) )
+  {
+    switch( c ) {
+      case 'h' : help = 1;                 break;
+      case 'm' : speed = 0;                break;
+      case 's' : speed = strtod( optarg, NULL );
+                 if ( speed <= 0 )
+                   err_quit( "Speed must be greater than 0: %s", optarg );
+                                           break;
+      case 't' : linger = strtod( optarg, NULL ); break;
+      case 'v' : verbose = 1;              break;
+      default  : err_quit( "Unrecognized option: -%c", optopt ); break;
+    }
+  }
+
+  if ( 1 == help ) {
+    usage( pname );
+    exit( EXIT_SUCCESS );
+  }
+
+  if ( argc <= optind )
+    err_quit( "Usage: %s [-hmv -s <speed> -t <sec>] <file> "
+              "[<program> [args]]", pname );
+
+  if ( 0 != atexit( cleanup ) )
+    err_sys( "Cannot install the exit-handler" );
+
+  if ( 0 == strcmp( argv[optind], "-" ) )
+    fp = fdopen( dup( STDIN_FILENO ), "rb" );
+  else
+    fp = fopen( argv[optind], "rb" );
+
+  if ( NULL == fp )
+    err_sys( "Cannot open %s", argv[optind] );
+
+  if ( 0 > rec_check( fp ) )
+    err_quit( "Not a recording: %s", argv[optind] );
+
+  if ( argc > optind+1 )
+    exit( replay_program( &argv[optind+1], speed, linger, verbose ) );
+
+  exit( replay_output( speed, verbose ) );
+}
+
+
+void usage( const char *prog_name )
+{
+  printf( "Usage: %s [OPTIONS] <file> [<program> [ARGS]]\n", prog_name );
+  printf( "  Replay a session recording of 'pty -w <file>' (- for STDIN).\n" );
+  printf( "  OPTIONS:\n" );
+  printf( "    -s <x>    : Speed factor, e.g. 2 is twice as fast (default: 1).\n" );
+  printf( "    -m        : Full speed, no waiting.\n" );
+  printf( "    -t <sec>  : With <program>: Stop it <sec> after the recording\n" );
+  printf( "                has ended (default: wait until it ends).\n" );
+  printf( "    -v        : Report how late the records were replayed.\n" );
+  printf( "    -h        : Print this help.\n" );
+  printf( "  Without <program> the recorded output is written to STDOUT.\n" );
+  printf( "  With <program> it is started on a PTY (no echo) and gets the\n" );
+  printf( "  recorded input instead. Its output goes to STDOUT, response\n" );
+  printf( "  times are reported on STDERR.\n" );
+  puts( "" );
+}
+// EOF
@@ -14,6 +14,21 @@ test_exit()
 }
 
 
+###################################################
+## HEX kernels (SSE2/AVX2) against the scalar one #
+###################################################
+test_hex_kernels()
+{
+	if [ -e ./bin/hexchecks ]; then
+		if ./bin/hexchecks -v; then
+			printf '\nTest HEX kernels: Success\n'
+		else
+			printf '\nTest HEX kernels: Failure\n'
+		fi
+	fi
+}
+
+
 ###################################################
 ## pty-program in loopback-test (no driver) #######
 ###################################################
@@ -63,6 +78,9 @@ printf '\nAbort with CTRL+C\n\n'
 #test_exit
 printf '\n'
 
+test_hex_kernels
+printf '\n'
+
 #test_pty_nodriver
 printf '\n'
 
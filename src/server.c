@@ -0,0 +1,1299 @@
+/* vi: set sw=4 ts=4: */
+
+/*
+ * Copyright (C) 2026
+ * Khoa Sebastian Nguyen
+ * <sebastian.nguyen@asog-central.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "pty.h"
+#include "daemon.h"
+#include "server.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#define SESSION_BUFSIZE       ( 16*1024 )
+#ifndef SESSION_SCROLLBACK
+  #define SESSION_SCROLLBACK  ( 64*1024 )  // output kept for an attach
+#endif
+#define SESSION_CMD_MAX       ( 256 )
+#define SESSION_ARGS_MAX      ( 64 )
+#define SERVER_MAX_EVENTS     ( 64 )
+#define SERVER_START_TRIES    ( 50 )   // wait for a starting server [10 ms]
+#define SESSION_DRAIN_TIMEOUT ( 200 )  // last output to a client [ms]
+
+
+/*!
+ * \brief    Kind of a descriptor in the epoll set of the server.
+ */
+enum {
+  WATCH_LISTEN,
+  WATCH_SIGNAL,
+  WATCH_CONN,
+  WATCH_MASTER,
+  WATCH_CLIENT
+};
+
+
+typedef struct {
+  int kind;
+  void *obj;
+} tServer_tag;
+
+
+/*!
+ * \brief    A program running on a PTY, owned by the server.
+ */
+typedef struct tSession {
+  int id;
+  pid_t pid;
+  int fdm;                        // PTY master
+  int client;                     // attached client, -1 if detached
+  int hup;                        // PTY slave closed
+  int direct;                     // client holds the PTY master itself
+  uint32_t ev_m;                  // registered events of fdm
+  uint32_t ev_c;                  // registered events of client
+  char pts[PTS_NAME_LENGTH];
+  char cmd[SESSION_CMD_MAX];
+  char ring[SESSION_SCROLLBACK];  // last output of the program
+  uint64_t head;                  // bytes ever read from fdm
+  uint64_t sent;                  // of them sent to the client
+  char ibuf[SESSION_BUFSIZE];     // client input to the program
+  size_t ilen, ioff;
+  tServer_tag tm, tc;
+  struct tSession *next;
+} tSession;
+
+
+/*!
+ * \brief    A client connection that has not sent its request line yet.
+ */
+typedef struct tConn {
+  int fd;
+  size_t len;
+  char req[SERVER_REQUEST_MAX];
+  tServer_tag t;
+  struct tConn *next;
+} tConn;
+
+
+typedef struct {
+  int ep;
+  int next_id;
+  int started;                    // a session was created
+  int nsessions;
+  tSession *sessions;
+  tConn *conns;
+  sigset_t omask;                 // signal mask to restore for programs
+} tServer;
+
+
+void server_socket_path( char *path )
+{
+  snprintf( path, SERVER_SOCKET_LENGTH, SERVER_SOCKET_FMT,
+            (unsigned)getuid() );
+}
+
+
+static int _server_addr( struct sockaddr_un *un, const char *path )
+{
+  memset( un, 0, sizeof( *un ) );
+  un->sun_family = AF_UNIX;
+
+  if ( strlen( path ) >= sizeof( un->sun_path ) ) {
+    errno = ENAMETOOLONG;
+    return ( -1 );
+  }
+
+  strcpy( un->sun_path, path );
+
+  return ( 0 );
+}
+
+
+int server_connect( const char *path )
+{
+  struct sockaddr_un un;
+  struct ucred cr;
+  socklen_t len = sizeof( cr );
+  int fd;
+
+  if ( 0 > _server_addr( &un, path ) )
+    return ( -1 );
+
+  if ( 0 > (fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) )
+    return ( -1 );
+
+  if ( 0 > connect( fd, (struct sockaddr*)&un, sizeof( un ) ) )
+    goto server_connect_errout;
+
+  // Anyone may bind the path in /tmp first, talk to our own server only:
+  if ( 0 > getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cr, &len ) )
+    goto server_connect_errout;
+
+  if ( cr.uid != getuid() ) {
+    errno = EPERM;
+    goto server_connect_errout;
+  }
+
+  return ( fd );
+
+server_connect_errout:
+  close( fd );
+  return ( -1 );
+}
+
+
+int server_listen( const char *path )
+{
+  struct sockaddr_un un;
+  mode_t mask;
+  int fd, fdc;
+
+  if ( 0 > _server_addr( &un, path ) )
+    return ( -1 );
+
+  if ( 0 > (fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) )
+    return ( -1 );
+
+  // Sessions are for the owner only, from the first moment on:
+  mask = umask( S_IRWXG | S_IRWXO );
+
+  if ( 0 > bind( fd, (struct sockaddr*)&un, sizeof( un ) ) ) {
+    if ( EADDRINUSE != errno )
+      goto server_listen_errout;
+
+    // Someone answering? Else it is left over from a crashed server:
+    if ( 0 <= (fdc = server_connect( path )) ) {
+      close( fdc );
+      errno = EADDRINUSE;
+      goto server_listen_errout;
+    }
+    if ( EPERM == errno )  // a server of another user, not ours to replace
+      goto server_listen_errout;
+
+    unlink( path );
+    if ( 0 > bind( fd, (struct sockaddr*)&un, sizeof( un ) ) )
+      goto server_listen_errout;
+  }
+
+  umask( mask );
+
+  if ( 0 > chmod( path, S_IRUSR | S_IWUSR ) )
+    goto server_listen_errout;
+
+  if ( 0 > listen( fd, SOMAXCONN ) )
+    goto server_listen_errout;
+
+  return ( fd );
+
+server_listen_errout:
+  umask( mask );
+  close( fd );
+  return ( -1 );
+}
+
+
+static int _server_watch( tServer *srv, int op, int fd, uint32_t events,
+                          tServer_tag *tag )
+{
+  struct epoll_event ev;
+
+  ev.events = events;
+  ev.data.ptr = tag;
+
+  return ( epoll_ctl( srv->ep, op, fd, &ev ) );
+}
+
+
+static void _set_nonblock( int fd )
+{
+  fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+}
+
+
+/*!
+ * \brief    Map len bytes of the ring, starting at the stream position pos,
+ *           to its (at most two) segments.
+ * \return   Number of iovec entries used.
+ */
+static int _ring_iov( tSession *s, uint64_t pos, size_t len,
+                      struct iovec *iov )
+{
+  size_t off = (size_t)(pos % SESSION_SCROLLBACK);
+  size_t first = SESSION_SCROLLBACK - off;
+
+  if ( first > len )
+    first = len;
+
+  iov[0].iov_base = s->ring + off;
+  iov[0].iov_len = first;
+
+  if ( first == len )
+    return ( 1 );
+
+  iov[1].iov_base = s->ring;
+  iov[1].iov_len = len - first;
+
+  return ( 2 );
+}
+
+
+/*!
+ * \brief    Bytes the ring may take now. Without a client the oldest output
+ *           is overwritten, an attached client is not overrun.
+ */
+static size_t _ring_room( tSession *s )
+{
+  if ( s->client < 0 )
+    return ( SESSION_SCROLLBACK );
+
+  return ( SESSION_SCROLLBACK - (size_t)(s->head - s->sent) );
+}
+
+
+/*!
+ * \brief    Register the events a session needs now. The PTY is read while
+ *           detached too, the program never blocks on a full PTY buffer.
+ */
+static void _session_events( tServer *srv, tSession *s )
+{
+  uint32_t m = 0, c = 0;
+
+  if ( 0 == s->hup ) {
+    if ( (0 == s->direct) && (_ring_room( s ) > 0) )
+      m |= EPOLLIN;
+    if ( s->ilen > 0 )
+      m |= EPOLLOUT;
+
+    if ( m != s->ev_m ) {
+      _server_watch( srv, EPOLL_CTL_MOD, s->fdm, m, &s->tm );
+      s->ev_m = m;
+    }
+  }
+
+  if ( 0 <= s->client ) {
+    if ( 0 == s->ilen )
+      c |= EPOLLIN;
+    if ( s->sent < s->head )
+      c |= EPOLLOUT;
+
+    if ( c != s->ev_c ) {
+      _server_watch( srv, EPOLL_CTL_MOD, s->client, c, &s->tc );
+      s->ev_c = c;
+    }
+  }
+}
+
+
+static void _session_detach( tServer *srv, tSession *s )
+{
+  if ( s->client < 0 )
+    return;
+
+  epoll_ctl( srv->ep, EPOLL_CTL_DEL, s->client, NULL );
+  close( s->client );
+
+  s->client = -1;
+  s->ev_c = 0;
+  s->direct = 0;
+}
+
+
+static void _session_hup( tServer *srv, tSession *s )
+{
+  if ( 1 == s->hup )
+    return;
+
+  epoll_ctl( srv->ep, EPOLL_CTL_DEL, s->fdm, NULL );
+  s->hup = 1;
+  s->ilen = s->ioff = 0;
+}
+
+
+/*!
+ * \brief    Read the program output into the ring.
+ */
+static void _session_fill( tServer *srv, tSession *s )
+{
+  struct iovec iov[2];
+  size_t room;
+  ssize_t n;
+
+  if ( 0 == (room = _ring_room( s )) )
+    return;
+
+  n = readv( s->fdm, iov, _ring_iov( s, s->head, room, iov ) );
+
+  if ( n > 0 )
+    s->head += (uint64_t)n;
+  else if ( (0 == n) || (EAGAIN != errno) )
+    _session_hup( srv, s ); // EIO: all slaves closed
+}
+
+
+static void _session_pump_out( tServer *srv, tSession *s )
+{
+  struct iovec iov[2];
+  ssize_t n;
+
+  while ( (0 <= s->client) && (s->sent < s->head) ) {
+    n = writev( s->client, iov,
+                _ring_iov( s, s->sent, (size_t)(s->head - s->sent), iov ) );
+    if ( 0 > n ) {
+      if ( EAGAIN != errno )
+        _session_detach( srv, s ); // client is gone
+      return;
+    }
+    s->sent += (uint64_t)n;
+  }
+}
+
+
+static void _session_pump_in( tServer *srv, tSession *s )
+{
+  ssize_t n;
+
+  while ( s->ioff < s->ilen ) {
+    if ( 0 > (n = write( s->fdm, s->ibuf + s->ioff, s->ilen - s->ioff )) ) {
+      if ( EAGAIN != errno )
+        _session_hup( srv, s );
+      return;
+    }
+    s->ioff += (size_t)n;
+  }
+
+  s->ilen = s->ioff = 0;
+}
+
+
+static tSession *_session_find( tServer *srv, int id )
+{
+  tSession *s;
+
+  for ( s=srv->sessions; NULL != s; s=s->next )
+    if ( id == s->id )
+      return ( s );
+
+  return ( NULL );
+}
+
+
+/*!
+ * \brief    The program has ended: Copy its last output to the client, then
+ *           release the session. A client not reading gets what fits within
+ *           SESSION_DRAIN_TIMEOUT, the other sessions must not wait for it.
+ */
+static void _session_end( tServer *srv, tSession *s, int status )
+{
+  tSession **pp;
+  struct pollfd pfd;
+  uint64_t deadline, now, sent;
+
+  if ( (0 <= s->client) && (0 == s->direct) ) {
+    deadline = pty_deadline( SESSION_DRAIN_TIMEOUT );
+    do {
+      sent = s->sent;
+      _session_pump_out( srv, s );
+      if ( 0 == s->hup )
+        _session_fill( srv, s );
+
+      if ( (0 <= s->client) && (sent == s->sent) && (s->sent < s->head) ) {
+        if ( deadline <= (now = pace_now()) )
+          break;
+        pfd.fd = s->client;
+        pfd.events = POLLOUT;
+        if ( 0 >= poll( &pfd, 1, (int)((deadline - now)/PACE_NS_PER_MS) + 1 ) )
+          break;
+      }
+    } while ( (0 <= s->client) && (s->sent < s->head) );
+  }
+
+  syslog( LOG_INFO, "Session %i (%s) ended, status %i", s->id, s->cmd,
+          WIFEXITED( status ) ? WEXITSTATUS( status ) : -1 );
+
+  _session_detach( srv, s );
+  _session_hup( srv, s );
+  close( s->fdm );
+
+  for ( pp=&srv->sessions; NULL != *pp; pp=&(*pp)->next ) {
+    if ( s == *pp ) {
+      *pp = s->next;
+      break;
+    }
+  }
+
+  srv->nsessions--;
+  free( s );
+}
+
+
+/*!
+ * \brief    Split a command line in place at blanks. Single or double quotes
+ *           group words, like a shell does (without escapes).
+ * \return   Number of arguments, argv is NULL terminated.
+ */
+static int _server_argv( char *line, char **argv, int nmax )
+{
+  char *o = line;
+  char quote;
+  int n = 0;
+
+  while ( n < nmax-1 ) {
+    while ( (' ' == *line) || ('\t' == *line) )
+      line++;
+    if ( '\0' == *line )
+      break;
+
+    argv[n++] = o;
+    quote = '\0';
+
+    for ( ; '\0' != *line; line++ ) {
+      if ( ('\0' == quote) && ((' ' == *line) || ('\t' == *line)) )
+        break;
+      if ( ('\0' == quote) && (('\'' == *line) || ('"' == *line)) )
+        quote = *line;
+      else if ( quote == *line )
+        quote = '\0';
+      else
+        *o++ = *line;
+    }
+
+    if ( '\0' != *line )
+      line++;
+    *o++ = '\0';
+  }
+
+  argv[n] = NULL;
+
+  return ( n );
+}
+
+
+static tSession *_session_new( tServer *srv, const char *cwd, char *cmd )
+{
+  char *argv[SESSION_ARGS_MAX];
+  tSession *s;
+
+  if ( NULL == (s = (tSession*)calloc( 1, sizeof( tSession ) )) )
+    return ( NULL );
+
+  snprintf( s->cmd, sizeof( s->cmd ), "%s", cmd );
+
+  if ( 0 > (s->pid = pty_fork_init( &s->fdm, s->pts, sizeof( s->pts ), NULL,
+                                    1 )) ) {
+    free( s );
+    return ( NULL );
+  }
+
+  if ( 0 == s->pid ) {
+    ///////////////////////////////
+    // Inside the child process: //
+    ///////////////////////////////
+
+    // Programs get the signal settings of a shell, not of the daemon:
+    signal( SIGHUP, SIG_DFL );
+    signal( SIGPIPE, SIG_DFL );
+    sigprocmask( SIG_SETMASK, &srv->omask, NULL );
+
+    if ( 0 > chdir( cwd ) )
+      err_msg( "Cannot change to directory %s", cwd );
+
+    if ( 0 == _server_argv( cmd, argv, SESSION_ARGS_MAX ) )
+      err_quit( "No program given" );
+    execvp( argv[0], argv );
+    err_sys( "Execution error: %s", argv[0] );
+  }
+
+  ////////////////////////////////
+  // Inside the parent process: //
+  ////////////////////////////////
+  fcntl( s->fdm, F_SETFD, FD_CLOEXEC ); // not for the next sessions programs
+  _set_nonblock( s->fdm );
+
+  s->id = srv->next_id++;
+  s->client = -1;
+  s->tm.kind = WATCH_MASTER;
+  s->tc.kind = WATCH_CLIENT;
+  s->tm.obj = s->tc.obj = s;
+
+  _server_watch( srv, EPOLL_CTL_ADD, s->fdm, 0, &s->tm );
+  _session_events( srv, s );
+
+  s->next = srv->sessions;
+  srv->sessions = s;
+  srv->nsessions++;
+  srv->started = 1;
+
+  syslog( LOG_INFO, "Session %i (%s) on %s", s->id, s->cmd, s->pts );
+
+  return ( s );
+}
+
+
+static void _conn_close( tServer *srv, tConn *c )
+{
+  tConn **pp;
+
+  for ( pp=&srv->conns; NULL != *pp; pp=&(*pp)->next ) {
+    if ( c == *pp ) {
+      *pp = c->next;
+      break;
+    }
+  }
+
+  if ( 0 <= c->fd ) {
+    epoll_ctl( srv->ep, EPOLL_CTL_DEL, c->fd, NULL );
+    close( c->fd );
+  }
+
+  free( c );
+}
+
+
+static void _conn_reply( tConn *c, const char *fmt, ... )
+{
+  char line[SERVER_REQUEST_MAX];
+  va_list ap;
+  int n;
+
+  va_start( ap, fmt );
+  n = vsnprintf( line, sizeof( line ), fmt, ap );
+  va_end( ap );
+
+  if ( n >= (int)sizeof( line ) )
+    n = sizeof( line ) - 1;
+
+  full_write( c->fd, line, (size_t)n ); // waits for room, O_NONBLOCK or not
+}
+
+
+/*!
+ * \brief    Reply a line with a file descriptor attached (SCM_RIGHTS).
+ * \return   0 if o.k, -1 on error.
+ */
+static int _conn_reply_fd( tConn *c, const char *line, int fd )
+{
+  char ctl[CMSG_SPACE( sizeof( int ) )];
+  struct cmsghdr *cm;
+  struct msghdr msg;
+  struct iovec iov;
+
+  memset( &msg, 0, sizeof( msg ) );
+  memset( ctl, 0, sizeof( ctl ) );
+
+  iov.iov_base = (void*)line;
+  iov.iov_len = strlen( line );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl;
+  msg.msg_controllen = sizeof( ctl );
+
+  cm = CMSG_FIRSTHDR( &msg );
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN( sizeof( int ) );
+  memcpy( CMSG_DATA( cm ), &fd, sizeof( int ) );
+
+  fcntl( c->fd, F_SETFL, fcntl( c->fd, F_GETFL ) & ~O_NONBLOCK );
+  if ( (ssize_t)iov.iov_len != sendmsg( c->fd, &msg, MSG_NOSIGNAL ) )
+    return ( -1 );
+  fcntl( c->fd, F_SETFL, fcntl( c->fd, F_GETFL ) | O_NONBLOCK );
+
+  return ( 0 );
+}
+
+
+/*!
+ * \brief    Only our own user (or root) may talk to the server: Every request
+ *           runs programs or reaches sessions with our rights. The socket
+ *           mode is not relied on alone.
+ */
+static int _conn_trusted( int fd )
+{
+  struct ucred cr;
+  socklen_t len = sizeof( cr );
+
+  if ( 0 > getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cr, &len ) )
+    return ( 0 );
+
+  return ( (cr.uid == getuid()) || (0 == cr.uid) );
+}
+
+
+/*!
+ * \brief    The connection becomes the client of the session.
+ */
+static void _session_client( tServer *srv, tSession *s, tConn *c )
+{
+  epoll_ctl( srv->ep, EPOLL_CTL_DEL, c->fd, NULL );
+  s->client = c->fd;
+  s->ev_c = EPOLLIN;
+  _server_watch( srv, EPOLL_CTL_ADD, s->client, s->ev_c, &s->tc );
+  c->fd = -1;
+}
+
+
+/*!
+ * \brief    Split a request line at TABs, the last field takes the rest.
+ * \return   Number of fields.
+ */
+static int _split( char *line, char **f, int nmax )
+{
+  int n = 0;
+
+  f[n++] = line;
+
+  while ( (n < nmax) && (NULL != (line = strchr( line, '\t' ))) ) {
+    *line++ = '\0';
+    f[n++] = line;
+  }
+
+  return ( n );
+}
+
+
+static void _conn_request( tServer *srv, tConn *c, size_t linelen )
+{
+  char line[SERVER_REQUEST_MAX];
+  struct winsize ws;
+  tSession *s;
+  char *f[4];
+  size_t rest;
+  int n;
+
+  c->req[linelen] = '\0';
+  n = _split( c->req, f, 4 );
+
+  if ( (0 == strcmp( f[0], "NEW" )) && (3 == n) ) {
+    if ( NULL == (s = _session_new( srv, f[1], f[2] )) )
+      _conn_reply( c, "ERR\t%s\n", strerror( errno ) );
+    else
+      _conn_reply( c, "OK\t%i\t%s\n", s->id, s->pts );
+
+  } else if ( (0 == strcmp( f[0], "LIST" )) && (1 == n) ) {
+    for ( s=srv->sessions; NULL != s; s=s->next )
+      _conn_reply( c, "%i\t%i\t%s\t%i\t%s\n", s->id, (int)s->pid, s->pts,
+                   (0 > s->client) ? 0 : ((1 == s->direct) ? 2 : 1), s->cmd );
+
+  } else if ( (0 == strcmp( f[0], "ATTACH" )) && (4 == n) ) {
+    if ( NULL == (s = _session_find( srv, atoi( f[1] ) )) ) {
+      _conn_reply( c, "ERR\tNo such session\n" );
+    } else if ( 1 == s->direct ) {
+      _conn_reply( c, "ERR\tSession is taken exclusively\n" );
+    } else {
+      _session_detach( srv, s ); // taken over
+      _conn_reply( c, "OK\t%i\n", s->id );
+
+      memset( &ws, 0, sizeof( ws ) );
+      ws.ws_row = (unsigned short)atoi( f[2] );
+      ws.ws_col = (unsigned short)atoi( f[3] );
+      if ( (ws.ws_row > 0) && (ws.ws_col > 0) && (0 == s->hup) )
+        ioctl( s->fdm, TIOCSWINSZ, &ws );
+
+      _session_client( srv, s, c );
+
+      // Replay the scrollback, one writev() on the two ring segments:
+      s->sent = (s->head > SESSION_SCROLLBACK) ?
+                s->head - SESSION_SCROLLBACK : 0;
+      _session_pump_out( srv, s );
+
+      // Input typed right behind the request:
+      rest = c->len - linelen - 1;
+      if ( (rest > 0) && (0 == s->hup) ) {
+        memcpy( s->ibuf, c->req + linelen + 1, rest );
+        s->ilen = rest;
+        s->ioff = 0;
+        _session_pump_in( srv, s );
+      }
+
+      _session_events( srv, s );
+    }
+
+  } else if ( (0 == strcmp( f[0], "TAKE" )) && (2 == n) ) {
+    if ( NULL == (s = _session_find( srv, atoi( f[1] ) )) ) {
+      _conn_reply( c, "ERR\tNo such session\n" );
+    } else if ( 1 == s->direct ) {
+      _conn_reply( c, "ERR\tSession is taken exclusively\n" );
+    } else if ( 1 == s->hup ) {
+      _conn_reply( c, "ERR\tSession has ended\n" );
+    } else {
+      _session_detach( srv, s ); // taken over
+      snprintf( line, sizeof( line ), "OK\t%i\n", s->id );
+
+      /*!
+       * \note   The server keeps its own copy of the master, but does not
+       *         read it until the connection is closed. The scrollback is
+       *         not replayed, the client asks for the master to get raw
+       *         program I/O.
+       */
+      if ( 0 == _conn_reply_fd( c, line, s->fdm ) ) {
+        _session_client( srv, s, c );
+        s->direct = 1;
+        s->sent = s->head;
+        _session_events( srv, s );
+      }
+    }
+
+  } else {
+    _conn_reply( c, "ERR\tBad request\n" );
+  }
+
+  _conn_close( srv, c );
+}
+
+
+static void _conn_read( tServer *srv, tConn *c )
+{
+  char *nl;
+  ssize_t n;
+
+  n = read( c->fd, c->req + c->len, sizeof( c->req ) - 1 - c->len );
+
+  if ( (0 > n) && (EAGAIN == errno) )
+    return;
+
+  if ( n <= 0 ) {
+    _conn_close( srv, c );
+    return;
+  }
+
+  c->len += (size_t)n;
+
+  if ( NULL != (nl = (char*)memchr( c->req, '\n', c->len )) ) {
+    _conn_request( srv, c, (size_t)(nl - c->req) );
+  } else if ( c->len >= sizeof( c->req ) - 1 ) {
+    _conn_reply( c, "ERR\tRequest too long\n" );
+    _conn_close( srv, c );
+  }
+}
+
+
+static void _server_accept( tServer *srv, int fd_listen )
+{
+  tConn *c;
+  int fd;
+
+  if ( 0 > (fd = accept4( fd_listen, NULL, NULL,
+                          SOCK_CLOEXEC | SOCK_NONBLOCK )) )
+    return;
+
+  if ( 0 == _conn_trusted( fd ) ) {
+    syslog( LOG_WARNING, "Connection of a foreign user refused" );
+    close( fd );
+    return;
+  }
+
+  if ( NULL == (c = (tConn*)calloc( 1, sizeof( tConn ) )) ) {
+    close( fd );
+    return;
+  }
+
+  c->fd = fd;
+  c->t.kind = WATCH_CONN;
+  c->t.obj = c;
+  c->next = srv->conns;
+  srv->conns = c;
+
+  _server_watch( srv, EPOLL_CTL_ADD, fd, EPOLLIN, &c->t );
+}
+
+
+static void _server_event( tServer *srv, tServer_tag *t, uint32_t events )
+{
+  tSession *s = (tSession*)t->obj;
+  ssize_t n;
+
+  switch ( t->kind ) {
+    case WATCH_CONN:
+      _conn_read( srv, (tConn*)t->obj );
+      return;
+
+    case WATCH_MASTER:
+      if ( (events & EPOLLOUT) && (s->ilen > 0) )
+        _session_pump_in( srv, s );
+
+      if ( (0 == s->hup) && (s->ev_m & EPOLLIN) &&
+           (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ) {
+        _session_fill( srv, s );
+        _session_pump_out( srv, s );
+      } else if ( (0 == s->hup) && (events & (EPOLLHUP | EPOLLERR)) &&
+                  (0 == (s->ev_m & EPOLLIN)) ) {
+        _session_hup( srv, s ); // would be reported again and again
+      }
+      break;
+
+    case WATCH_CLIENT:
+      if ( events & EPOLLOUT )
+        _session_pump_out( srv, s );
+
+      if ( (0 <= s->client) && (0 == s->ilen) &&
+           (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ) {
+        n = read( s->client, s->ibuf, sizeof( s->ibuf ) );
+        if ( n > 0 ) {
+          if ( 0 == s->hup ) {
+            s->ilen = (size_t)n;
+            s->ioff = 0;
+            _session_pump_in( srv, s );
+          }
+        } else if ( (0 == n) || (EAGAIN != errno) ) {
+          _session_detach( srv, s );
+        }
+      }
+      break;
+  }
+
+  _session_events( srv, s );
+}
+
+
+/*!
+ * \brief    SIGCHLD: Find the sessions whose program has ended.
+ */
+static void _server_reap( tServer *srv )
+{
+  tSession *s;
+  pid_t pid;
+  int status;
+
+  while ( 0 < (pid = waitpid( -1, &status, WNOHANG )) ) {
+    for ( s=srv->sessions; NULL != s; s=s->next ) {
+      if ( pid == s->pid ) {
+        _session_end( srv, s, status );
+        break;
+      }
+    }
+  }
+}
+
+
+int server_run( int fd_listen )
+{
+  struct epoll_event ev[SERVER_MAX_EVENTS];
+  struct signalfd_siginfo si;
+  tServer_tag tl, ts;
+  tServer srv;
+  sigset_t mask;
+  int sfd, retval = 0;
+  int run = 1;
+  int i, k;
+
+  memset( &srv, 0, sizeof( srv ) );
+  srv.next_id = 1;
+
+  // A client going away must not kill us on write:
+  signal( SIGPIPE, SIG_IGN );
+
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGINT );
+  sigaddset( &mask, SIGTERM );
+  sigaddset( &mask, SIGCHLD );
+
+  if ( 0 > sigprocmask( SIG_BLOCK, &mask, &srv.omask ) )
+    return ( -1 );
+
+  if ( 0 > (sfd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC )) )
+    return ( -1 );
+
+  if ( 0 > (srv.ep = epoll_create1( EPOLL_CLOEXEC )) ) {
+    close( sfd );
+    return ( -1 );
+  }
+
+  tl.kind = WATCH_LISTEN;
+  ts.kind = WATCH_SIGNAL;
+  _server_watch( &srv, EPOLL_CTL_ADD, fd_listen, EPOLLIN, &tl );
+  _server_watch( &srv, EPOLL_CTL_ADD, sfd, EPOLLIN, &ts );
+
+  _set_nonblock( fd_listen );
+
+  while ( (1 == run) && ((0 == srv.started) || (srv.nsessions > 0)) ) {
+    if ( 0 > (k = epoll_wait( srv.ep, ev, SERVER_MAX_EVENTS, -1 )) ) {
+      if ( EINTR == errno )
+        continue;
+      syslog( LOG_ERR, "Server event loop failure: %s", strerror( errno ) );
+      retval = -1;
+      break;
+    }
+
+    for ( i=0; i<k; i++ ) {
+      tServer_tag *t = (tServer_tag*)ev[i].data.ptr;
+
+      if ( WATCH_LISTEN == t->kind ) {
+        _server_accept( &srv, fd_listen );
+      } else if ( WATCH_SIGNAL == t->kind ) {
+        while ( sizeof( si ) == read( sfd, &si, sizeof( si ) ) ) {
+          if ( SIGCHLD == si.ssi_signo )
+            _server_reap( &srv );
+          else
+            run = 0;
+        }
+      } else {
+        _server_event( &srv, t, ev[i].events );
+      }
+
+      /*!
+       * \note   A session ended in this round may still have events in ev[],
+       *         the remaining ones are fetched again instead.
+       */
+      if ( WATCH_SIGNAL == t->kind )
+        break;
+    }
+  }
+
+  // Hang up on the remaining programs like a terminal would:
+  while ( NULL != srv.sessions ) {
+    kill( srv.sessions->pid, SIGHUP );
+    _session_end( &srv, srv.sessions, 0 );
+  }
+
+  while ( NULL != srv.conns )
+    _conn_close( &srv, srv.conns );
+
+  close( srv.ep );
+  close( sfd );
+
+  return ( retval );
+}
+
+
+/*!
+ * \brief    Send a request and read the first reply line (not more, raw data
+ *           may follow).
+ * \return   Length of the reply, -1 on error.
+ */
+static int _server_request( int fd, const char *req, char *reply,
+                            size_t reply_size )
+{
+  size_t n = 0;
+  char c;
+
+  if ( 0 > full_write( fd, req, strlen( req ) ) )
+    return ( -1 );
+
+  while ( n < reply_size - 1 ) {
+    if ( 1 != read( fd, &c, 1 ) )
+      return ( -1 );
+    if ( '\n' == c )
+      break;
+    reply[n++] = c;
+  }
+
+  reply[n] = '\0';
+
+  return ( (int)n );
+}
+
+
+/*!
+ * \brief    Start a server on the socket in the background. Returns when it
+ *           accepts connections.
+ */
+static int _server_start( const char *path, int nochdir )
+{
+  int fd, fdn;
+  mode_t mask;
+  pid_t pid;
+
+  if ( 0 > (fd = server_listen( path )) )
+    return ( (EADDRINUSE == errno) ? 0 : -1 ); // raced with another start
+
+  fflush( stdout );
+  fflush( stderr );
+
+  mask = umask( 0 );
+  umask( mask );
+
+  if ( 0 > (pid = fork()) ) {
+    close( fd );
+    return ( -1 );
+  }
+
+  if ( 0 == pid ) {
+    /////////////////////////////////////////////
+    // Inside child, becomes the server daemon: //
+    /////////////////////////////////////////////
+    daemon_daemonize( "pty", nochdir, 1 );
+    umask( mask ); // for the programs, daemon_daemonize() clears it
+
+    if ( 0 <= (fdn = open( "/dev/null", O_RDWR )) ) {
+      dup2( fdn, STDIN_FILENO );
+      dup2( fdn, STDOUT_FILENO );
+      dup2( fdn, STDERR_FILENO );
+      if ( fdn > STDERR_FILENO )
+        close( fdn );
+    }
+
+    fd = server_run( fd );
+    unlink( path );
+    _exit( (0 > fd) ? 1 : 0 );
+  }
+
+  ////////////////////////////////
+  // Inside the parent process: //
+  ////////////////////////////////
+  close( fd ); // the socket listens already, connects are queued
+  waitpid( pid, NULL, 0 );
+
+  return ( 0 );
+}
+
+
+int server_new( const char *path, const char *program, int nochdir,
+                char *pts )
+{
+  char req[SERVER_REQUEST_MAX];
+  char reply[SERVER_REQUEST_MAX];
+  char cwd[SERVER_REQUEST_MAX/2];
+  char *f[3];
+  int fd, i;
+
+  if ( 0 > (fd = server_connect( path )) ) {
+    if ( 0 > _server_start( path, nochdir ) )
+      return ( -1 );
+
+    for ( i=0; (0 > fd) && (i < SERVER_START_TRIES); i++ ) {
+      if ( 0 > (fd = server_connect( path )) )
+        usleep( 10000 );
+    }
+
+    if ( 0 > fd )
+      return ( -1 );
+  }
+
+  if ( NULL == getcwd( cwd, sizeof( cwd ) ) )
+    strcpy( cwd, "/" );
+
+  if ( (int)sizeof( req ) <= snprintf( req, sizeof( req ), "NEW\t%s\t%s\n",
+                                       cwd, program ) ) {
+    errno = E2BIG;
+    goto server_new_errout;
+  }
+
+  if ( 0 > _server_request( fd, req, reply, sizeof( reply ) ) )
+    goto server_new_errout;
+
+  if ( (3 != _split( reply, f, 3 )) || (0 != strcmp( f[0], "OK" )) ) {
+    err_msg( "Server: %s", reply );
+    errno = EPROTO;
+    goto server_new_errout;
+  }
+
+  if ( NULL != pts ) {
+    strncpy( pts, f[2], PTS_NAME_LENGTH );
+    pts[PTS_NAME_LENGTH-1] = '\0';
+  }
+
+  close( fd );
+  return ( atoi( f[1] ) );
+
+server_new_errout:
+  close( fd );
+  return ( -1 );
+}
+
+
+/*!
+ * \brief    Send a TAKE request, receive the reply with the PTY master.
+ * \return   The master FD, -1 on error.
+ */
+static int _server_take( int fd, int id, char *reply, size_t reply_size )
+{
+  char ctl[CMSG_SPACE( sizeof( int ) )];
+  char req[SERVER_REQUEST_MAX];
+  struct cmsghdr *cm;
+  struct msghdr msg;
+  struct iovec iov;
+  int fdm = -1;
+  ssize_t n;
+
+  reply[0] = '\0';
+  snprintf( req, sizeof( req ), "TAKE\t%i\n", id );
+  if ( 0 > full_write( fd, req, strlen( req ) ) )
+    return ( -1 );
+
+  memset( &msg, 0, sizeof( msg ) );
+  iov.iov_base = reply;
+  iov.iov_len = reply_size - 1;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl;
+  msg.msg_controllen = sizeof( ctl );
+
+  // The reply line is one message, the FD comes with its first byte:
+  if ( 0 >= (n = recvmsg( fd, &msg, MSG_CMSG_CLOEXEC )) )
+    return ( -1 );
+
+  reply[n] = '\0';
+  reply[strcspn( reply, "\n" )] = '\0';
+
+  for ( cm=CMSG_FIRSTHDR( &msg ); NULL != cm; cm=CMSG_NXTHDR( &msg, cm ) ) {
+    if ( (SOL_SOCKET == cm->cmsg_level) && (SCM_RIGHTS == cm->cmsg_type) )
+      memcpy( &fdm, CMSG_DATA( cm ), sizeof( int ) );
+  }
+
+  return ( fdm );
+}
+
+
+int server_attach( const char *path, int id, int direct )
+{
+  char req[SERVER_REQUEST_MAX];
+  char reply[SERVER_REQUEST_MAX];
+  struct termios orig_termios;
+  struct winsize ws;
+  struct pollfd pfd;
+  tPty_loop lp;
+  int fd, fdm = -1, tty;
+  int ended;
+  char c;
+
+  if ( 0 > (fd = server_connect( path )) )
+    return ( -1 );
+
+  memset( &ws, 0, sizeof( ws ) );
+  if ( 1 == (tty = isatty( STDIN_FILENO )) )
+    ioctl( STDIN_FILENO, TIOCGWINSZ, &ws );
+
+  if ( 1 == direct ) {
+    fdm = _server_take( fd, id, reply, sizeof( reply ) );
+    if ( '\0' == reply[0] )
+      goto server_attach_errout;
+    if ( (0 <= fdm) && (ws.ws_row > 0) && (ws.ws_col > 0) )
+      ioctl( fdm, TIOCSWINSZ, &ws );
+  } else {
+    snprintf( req, sizeof( req ), "ATTACH\t%i\t%i\t%i\n", id,
+              (int)ws.ws_row, (int)ws.ws_col );
+    if ( 0 > _server_request( fd, req, reply, sizeof( reply ) ) )
+      goto server_attach_errout;
+  }
+
+  if ( (1 == direct) && (0 > fdm) && (0 == strncmp( reply, "OK", 2 )) ) {
+    err_msg( "Server: No PTY master received" );
+    errno = EPROTO;
+    goto server_attach_errout;
+  }
+
+  if ( 0 != strncmp( reply, "OK", 2 ) ) {
+    err_msg( "Server: %s", reply );
+    errno = ENOENT;
+    goto server_attach_errout;
+  }
+
+  // Keys go to the program, not to our line discipline:
+  if ( 1 == tty ) {
+    tty_save( STDIN_FILENO, &orig_termios, NULL );
+    if ( 0 > tty_raw_blocking( STDIN_FILENO, 1 ) )
+      goto server_attach_errout;
+  }
+
+  lp.fd_in = STDIN_FILENO;
+  lp.fd_out = STDOUT_FILENO;
+  lp.fd_dev_read = (0 <= fdm) ? fdm : fd;
+  lp.fd_dev_write = (0 <= fdm) ? fdm : fd;
+  lp.child = 0;
+  lp.ignore_eof = 0;
+  lp.translate = 0;
+  lp.nolf = 0;
+  lp.linefeed = NULL;
+  lp.bufsize = IOBUF_DEFAULT_CAP;
+  lp.engine = PTY_LOOP_AUTO;
+  lp.escape = (1 == tty) ? SERVER_DETACH_CHAR : -1;
+  lp.rec = NULL;
+  lp.pace = NULL;
+
+  pty_loop( &lp );
+
+  if ( 1 == tty ) {
+    tty_reset( STDIN_FILENO, &orig_termios, NULL );
+
+    // The server closes the connection when the program has ended, the
+    // master hangs up when all slaves are closed:
+    if ( 0 <= fdm ) {
+      pfd.fd = fdm;
+      pfd.events = POLLIN;
+      ended = ( (1 == poll( &pfd, 1, 0 )) && (pfd.revents & POLLHUP) );
+    } else {
+      ended = ( 0 == recv( fd, &c, 1, MSG_PEEK | MSG_DONTWAIT ) );
+    }
+
+    if ( ended )
+      err_msg( "\n[session %i ended]", id );
+    else
+      err_msg( "\n[detached from session %i]", id );
+  }
+
+  if ( 0 <= fdm )
+    close( fdm );
+  close( fd );
+  return ( 0 );
+
+server_attach_errout:
+  if ( 0 <= fdm )
+    close( fdm );
+  close( fd );
+  return ( -1 );
+}
+
+
+int server_list( const char *path )
+{
+  char buf[SERVER_REQUEST_MAX];
+  char *f[5];
+  FILE *fp;
+  int fd, n = 0;
+
+  if ( 0 > (fd = server_connect( path )) )
+    return ( -1 );
+
+  if ( 0 > full_write( fd, "LIST\n", 5 ) )
+    goto server_list_errout;
+
+  if ( NULL == (fp = fdopen( fd, "r" )) )
+    goto server_list_errout;
+
+  printf( "%-5s %-8s %-12s %-4s %s\n", "ID", "PID", "PTS", "ATT", "PROGRAM" );
+
+  while ( NULL != fgets( buf, sizeof( buf ), fp ) ) {
+    buf[strcspn( buf, "\n" )] = '\0';
+    if ( 5 != _split( buf, f, 5 ) )
+      continue;
+    printf( "%-5s %-8s %-12s %-4s %s\n", f[0], f[1], f[2],
+            ('0' == f[3][0]) ? "no" : (('2' == f[3][0]) ? "excl" : "yes"),
+            f[4] );
+    n++;
+  }
+
+  fclose( fp );
+  return ( n );
+
+server_list_errout:
+  close( fd );
+  return ( -1 );
+}
+
+// EOF
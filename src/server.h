@@ -0,0 +1,116 @@
+/* vi: set sw=4 ts=4: */
+
+/*!
+ * \version  1.0.0
+ * \author   ksnguyen
+ * \date     2026-10-15   Header created. Multi-session server for 'pty -b'.
+ *
+ * \note
+ *           One server process owns the PTY masters of many programs. They
+ *           keep running while no client is attached. Clients talk to the
+ *           server through a UNIX domain socket with one request line, fields
+ *           separated by TAB:
+ *
+ *             NEW    <cwd> <program [args]>   OK <id> <pts>
+ *             ATTACH <id> <rows> <cols>       OK <id>, then raw data
+ *             TAKE   <id>                     OK <id> with the PTY master
+ *                                             (SCM_RIGHTS)
+ *             LIST                            <id> <pid> <pts> <attached>
+ *                                             <program> per line
+ *
+ *           Errors are answered with "ERR <reason>". After an attach the
+ *           connection carries the session I/O in both directions. Closing it
+ *           detaches, the program does not notice. A new attach to a session
+ *           takes it over from the client attached before.
+ *
+ *           The server reads the PTY of a session all the time into a ring
+ *           buffer (scrollback), attached or not. An attach gets its content
+ *           first, the last output of the program.
+ *
+ *           TAKE is the exclusive attach for bulk transfers: The client gets
+ *           the PTY master itself and reads/writes the program without the
+ *           server in between. Meanwhile the server does not touch the PTY
+ *           and refuses other attaches, until the connection is closed.
+ *
+ *           Only the user of the server (or root) is served, connections of
+ *           other users are closed without an answer.
+ */
+
+#ifndef _PTY_SERVER_H
+  #define _PTY_SERVER_H
+
+#include <sys/types.h>
+
+#define SERVER_SOCKET_FMT     "/tmp/pty-%u.sock"  // default, %u: user ID
+#define SERVER_SOCKET_LENGTH  ( 108 )             // sizeof( sun_path )
+#define SERVER_REQUEST_MAX    ( 4096 )
+#define SERVER_DETACH_CHAR    ( 0x1D )            // CTRL-]
+
+
+/*!
+ * \brief    Default socket path of the calling user.
+ * \param    [OUT] *path        Buffer of SERVER_SOCKET_LENGTH characters.
+ */
+void server_socket_path( char *path );
+
+
+/*!
+ * \brief    Create the listening socket of a server. A stale socket file
+ *           (no server answering) is replaced.
+ * \return   The listening FD, -1 on error (errno set). EADDRINUSE if another
+ *           server is running already, EPERM if another user serves the
+ *           path.
+ */
+int server_listen( const char *path );
+
+
+/*!
+ * \brief    Connect to a running server of the calling user.
+ * \return   The connected FD, -1 on error (errno set). EPERM if the socket
+ *           is served by another user.
+ */
+int server_connect( const char *path );
+
+
+/*!
+ * \brief    Serve sessions until the last session has ended or SIGTERM is
+ *           received. The programs of remaining sessions get SIGHUP then,
+ *           like on a terminal hangup.
+ * \param    [IN]  fd_listen    Socket of server_listen().
+ * \return   0 if o.k, -1 on error.
+ */
+int server_run( int fd_listen );
+
+
+/*!
+ * \brief    Start a program in a new session. The server is started in the
+ *           background, if none is running on the socket.
+ * \param    [IN]  *path        Socket of the server.
+ * \param    [IN]  *program     Program and arguments, separated by blanks.
+ *                              Quotes group words.
+ * \param    [IN]  nochdir      Passed to daemon_daemonize() when the server
+ *                              is started.
+ * \param    [OUT] *pts         Name of the sessions PTS (PTS_NAME_LENGTH).
+ * \return   Session ID, -1 on error.
+ */
+int server_new( const char *path, const char *program, int nochdir,
+                char *pts );
+
+
+/*!
+ * \brief    Attach the calling terminal to a session, until the session ends
+ *           or SERVER_DETACH_CHAR is typed.
+ * \param    [IN]  direct       1: Take the PTY master (exclusive attach).
+ * \return   0 if o.k, -1 on error.
+ */
+int server_attach( const char *path, int id, int direct );
+
+
+/*!
+ * \brief    Print the sessions of the server on STDOUT.
+ * \return   Number of sessions, -1 on error.
+ */
+int server_list( const char *path );
+
+#endif // _PTY_SERVER_H
+// EOF
@@ -22,18 +22,19 @@
 
 #include "pty.h"
 
-#define BUFLEN   ( 128 )
+#define BUFLEN   ( IOBUF_DEFAULT_CAP ) // upper limit, buffers adapt
 
 #define P_IN     1                      // pipe in-port (write) 
 #define P_OUT    0                      // pipe out-port (read)
 
 #ifdef LINUX
-  #define OPTSTR "+acd:ehiIL:nrt:vx"
+  #define OPTSTR "+acd:ehiIL:np:q:rt:u:vx"
 #else
-  #define OPTSTR "acd:ehiIL:nrt:vx"
+  #define OPTSTR "acd:ehiIL:np:q:rt:u:vx"
 #endif
 
 #define MAX_EXEC_LENGTH ( (size_t)128 )
+#define TRANSACTION_TIMEOUT ( 1000 )    // [ms] default deadline of -q, -u
 
 const char *stdin_filename = "standard input";
 const char *pname;            // ourselves name
@@ -86,6 +87,138 @@ static void cleanup( void )
 }
 
 
+/*!
+ * \brief  Escapes \r, \n, \t and \\ of the delimiters of -u, in place.
+ */
+static char *unescape( char *str )
+{
+  char *in, *out;
+
+  for ( in=out=str; '\0' != *in; in++ ) {
+    if ( ('\\' == in[0]) && ('\0' != in[1]) ) {
+      switch ( *++in ) {
+        case 'r' : *out++ = '\r';  break;
+        case 'n' : *out++ = '\n';  break;
+        case 't' : *out++ = '\t';  break;
+        default  : *out++ = *in;   break;
+      }
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+
+  return ( str );
+}
+
+
+/*!
+ * \brief  Device transaction (-q, -u): Send all of STDIN to the device, then
+ *         read the answer with a deadline from the end of sending and write
+ *         it to STDOUT. Answers of any size, not limited by VMIN/VTIME.
+ * \param  [IN]  exact       Size of the answer, 0 to read until a delimiter.
+ * \param  [IN]  *until      Delimiters ending the answer (exact == 0).
+ * \param  [IN]  timeout     Deadline [ms].
+ * \param  [IN]  translate   HEX on STDIN and STDOUT.
+ * \param  [IN]  *pace       Pacing of the request, NULL for none.
+ * \return 0 if the answer is complete, 1 if the deadline has passed first.
+ */
+static int transaction( size_t exact, const char *until, unsigned int timeout,
+                        int translate, tPace *pace )
+{
+  tHex_decoder dec;
+  char *req = NULL;
+  char *ans = NULL;
+  char *hex = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  size_t cap = (0 < exact) ? exact : BUFLEN;
+  uint64_t deadline;
+  ssize_t n;
+  int err;
+
+  // Request, all of STDIN:
+  do {
+    if ( len == size ) {
+      size = (0 < size) ? 2*size : BUFLEN;
+      if ( NULL == (req = (char*)realloc( req, size )) )
+        err_sys( "Not enough space for the request" );
+    }
+    if ( 0 > (n = read( STDIN_FILENO, req + len, size - len )) ) {
+      if ( EINTR == errno )
+        continue;
+      err_sys( "Failed reading the request" );
+    }
+    len += (size_t)n;
+  } while ( 0 < n );
+
+  if ( 1 == translate ) {
+    hex_decoder_init( &dec, 1, 0 );
+    len = hex_decode_stream( &dec, (uint8_t*)req, req, len );
+    len += hex_decode_flush( &dec, (uint8_t*)req + len );
+  }
+
+  // An answer to an earlier request is no answer to this one:
+  if ( 1 == isatty( fdin ) )
+    tcflush( fdin, TCIFLUSH );
+
+  if ( NULL != pace )
+    n = pace_write( pace, fdout, req, len );
+  else
+    n = full_write( fdout, req, len );
+  if ( (ssize_t)len != n )
+    err_sys( "Write failure (FD=%i) ", fdout );
+  free( req );
+
+  // Answer:
+  if ( NULL == (ans = (char*)malloc( cap )) )
+    err_sys( "Not enough space for the answer" );
+
+  deadline = pty_deadline( timeout );
+
+  if ( 0 < exact ) {
+    n = pty_read_exact( fdin, ans, exact, deadline );
+    err = errno;
+  } else {
+    // Grow the buffer as long as the answer fills it without a delimiter:
+    for ( len = 0; ; len += (size_t)n ) {
+      if ( len == cap ) {
+        cap *= 2;
+        if ( NULL == (ans = (char*)realloc( ans, cap )) )
+          err_sys( "Not enough space for the answer" );
+      }
+      n = pty_read_until( fdin, ans + len, cap - len, until, deadline );
+      if ( (0 > n) || (ENOBUFS != errno) )
+        break;
+    }
+    err = errno;
+    if ( 0 <= n )
+      n += (ssize_t)len;
+  }
+
+  if ( 0 > n )
+    err_sys( "Read failure on device FD=%i", fdin );
+
+  if ( 1 == translate ) {
+    if ( NULL == (hex = (char*)malloc( 2*(size_t)n + 1 )) )
+      err_sys( "Not enough space for translation buffer" );
+    len = u8nprints( hex, 2*(size_t)n, (uint8_t*)ans, (size_t)n );
+    hex[len++] = '\n';
+    full_write( STDOUT_FILENO, hex, len );
+    free( hex );
+  } else {
+    full_write( STDOUT_FILENO, ans, (size_t)n );
+  }
+  free( ans );
+
+  if ( ETIMEDOUT == err )
+    err_msg( "Timeout, %li bytes of the answer received", (long)n );
+
+  return ( ((ETIMEDOUT == err) || ((0 < exact) && ((size_t)n < exact))) ?
+           1 : 0 );
+}
+
+
 #if defined( SOLARIS )
 static void solaris_ldterm( int fd )
 {
@@ -124,6 +257,10 @@ int main( int argc, char *argv[] )
   unsigned int timeout = 0;  // some devices do not process fluently
   const char *target;        // device to open
   struct winsize winsz_user; // our terminal window
+  tPace pace;                // transmit pacing of -p
+  int paced = 0;
+  size_t exact = 0;          // -q: size of the answer of a transaction
+  char *until = NULL;        // -u: delimiters of the answer of a transaction
 
   // Initialize program-wide variables:
   interactive = 1;
@@ -151,9 +288,14 @@ int main( int argc, char *argv[] )
       case 'I' : ignorelf = 1;      break;
       case 'L' : newnl = optarg;    break;
       case 'n' : interactive = 0;   break;
+      case 'p' : if ( 0 > pace_parse( &pace, optarg ) )
+                   err_quit( "Invalid pacing: %s", optarg );
+                 paced = 1;         break;
+      case 'q' : sscanf( optarg, "%zu", &exact ); break;
       case 'r' : rederr = 1;        break;
       case 'v' : verbose = 1;       break;
       case 't' : sscanf( optarg, "%u", &timeout ); break;
+      case 'u' : until = unescape( optarg ); break;
       case 'x' : xon = 1;           break;
       case '?' : err_sys( "Unrecognized option: -%c", optopt ); break;
     }
@@ -166,7 +308,7 @@ int main( int argc, char *argv[] )
   }
 
   if ( argc <= optind-1 )
-    err_sys( "Usage: %s [ -aehiInrvx -d <DRV> -t <TO> -L <LF> ] <device>", argv[0] );
+    err_sys( "Usage: %s [ -aehiInrvx -d <DRV> -p <PACE> -q <N> -u <DEL> -t <TO> -L <LF> ] <device>", argv[0] );
 
   if ( 0 == usedriver )
     driver = NULL;
@@ -189,6 +331,7 @@ int main( int argc, char *argv[] )
     // Attach to terminal or loop to STDOUT:
     target = stdin_filename;
     fdin = -1;
+    fdout = STDOUT_FILENO; // echo STDIN
 
     if ( fdout != STDOUT_FILENO ) {
       if ( dup2( fdout, STDOUT_FILENO ) != STDOUT_FILENO )
@@ -218,7 +361,9 @@ int main( int argc, char *argv[] )
       solaris_ldterm( fdout );
     #endif
 
-      if ( 1 == interactive )
+      if ( (0 < exact) || (NULL != until) )
+        tty_raw_blocking( fdin, 1 ); // deadline of the transaction, no VTIME
+      else if ( 1 == interactive )
         tty_interactive( fdin, NULL );
       else
         tty_raw_timeout( fdin, timeout );
@@ -238,6 +383,14 @@ int main( int argc, char *argv[] )
     fprintf( stderr, "Linefeed:        %s\n", newnl );
   }
 
+  if ( (0 < exact) || (NULL != until) ) {
+    if ( 0 > fdin )
+      err_quit( "A transaction needs a device" );
+    exit( transaction( exact, until,
+                       (0 < timeout) ? timeout : TRANSACTION_TIMEOUT,
+                       translate, (1 == paced) ? &pace : NULL ) );
+  }
+
 
   ////////////////////////////////
   // Adjust STDIN to file type ///
@@ -262,7 +415,8 @@ int main( int argc, char *argv[] )
     err_sys( "Failed to install signal handler for SIGINT" );
 
   // Fork into reader-/writer-process:
-  loop_duplex_stdio( fdin, fdout, ignoreeof, translate, BUFLEN, ignorelf, newnl );
+  loop_duplex_stdio( fdin, fdout, ignoreeof, translate, BUFLEN, ignorelf, newnl,
+                     (1 == paced) ? &pace : NULL );
 
   exit( 0 );
 }
@@ -282,6 +436,12 @@ void usage( const char *program_name )
   printf( "    -L <LF>  : Append additional LF on output. (default: none)\n" );
   printf( "               LF can be more than 1 byte long.\n" );
   printf( "    -n       : No-interactive. Do not use terminal modes.\n" );
+  printf( "    -p <PACE>: Pace the writes to the device, see PACE.\n" );
+  printf( "    -q <N>   : Transaction: Send stdin to the device, then print an\n" );
+  printf( "               answer of N bytes. -t is the deadline (default: %u).\n",
+          TRANSACTION_TIMEOUT );
+  printf( "    -u <DEL> : Transaction like -q, the answer ends with one of the\n" );
+  printf( "               characters of DEL (\\r, \\n, \\t allowed).\n" );
   printf( "    -t <TO>  : Maximum time [ms] etween subsequent characters.\n" );
   printf( "    -r       : Redirect stderr from driver to device.\n" );
   printf( "    -v       : Show options when executed.\n" );
@@ -295,6 +455,11 @@ void usage( const char *program_name )
   printf( "    This is usefull, when handling long cables or acting within\n" );
   printf( "    electromagnetic disturbed envirnments, or just in case the\n" );
   printf( "    communication endpoint is a bit slow in processing.\n" );
+  printf( "\n  PACE:\n" );
+  printf( "    <bytes/s>[,<burst>[,<gap>]] limits the writes to the device to\n" );
+  printf( "    bytes/s on average, at most burst bytes at once and a gap [ms]\n" );
+  printf( "    between two writes, so slow microcontrollers are not overrun.\n" );
+  printf( "    Example: -p 960,16,5\n" );
 }
 
 